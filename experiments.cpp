@@ -20,6 +20,21 @@ void experiment4();
 void experiment5();
 void experiment6();
 void experiment7(std::string, double, int, int, int, int);
+void experiment8();
+void experiment9();
+void experiment10();
+void experiment11();
+void experiment12();
+void experiment13();
+void experiment14();
+void experiment15();
+void experiment16();
+void experiment17();
+void experiment18();
+void experiment19();
+void experiment20();
+void experiment21();
+void experiment22();
 void datasetStatistics(std::string);
 
 int main(int argc, char const *argv[])
@@ -39,6 +54,21 @@ int main(int argc, char const *argv[])
   // int l = 6;
   // double J = 0.1;
   // experiment7(datasetName, J, b, r, m, l);
+  // experiment8();
+  // experiment9();
+  // experiment10();
+  // experiment11();
+  // experiment12();
+  // experiment13();
+  // experiment14();
+  // experiment15();
+  // experiment16();
+  // experiment17();
+  // experiment18();
+  // experiment19();
+  // experiment20();
+  // experiment21();
+  // experiment22();
   // datasetStatistics(datasetName);
   return 0;
 }
@@ -70,6 +100,15 @@ void experiment1()
 
       for (int l = 200; l <= 1000; l += 100)
         singleSetImplicit(k, l, N, tree_buffer);
+
+      // one permutation hashing, with the same number of bins
+      singleSetImplicitOPH(k, 1, N);
+
+      for (int l = 5; l <= 100; l += 5)
+        singleSetImplicitOPH(k, l, N);
+
+      for (int l = 200; l <= 1000; l += 100)
+        singleSetImplicitOPH(k, l, N);
     }
   }
 }
@@ -104,6 +143,15 @@ void experiment2()
 
       for (int l = 200; l <= 1000; l += 100)
         slidingWindowMinHash(k, l, U, 2 * N, max_size, tree_buffer);
+
+      // one permutation hashing, with the same number of bins
+      slidingWindowOPH(k, 1, U, 2 * N, max_size);
+
+      for (int l = 5; l <= 100; l += 5)
+        slidingWindowOPH(k, l, U, 2 * N, max_size);
+
+      for (int l = 200; l <= 1000; l += 100)
+        slidingWindowOPH(k, l, U, 2 * N, max_size);
     }
   }
 }
@@ -130,6 +178,15 @@ void experiment3()
       singleSetImplicit(K[i], l, N, tree_buffer);
   }
 
+  cout << "l-buffered OPH" << endl;
+
+#pragma omp parallel for collapse(2)
+  for (int i = 0; i < 6; i++)
+  {
+    for (int n = 0; n < n_tests; n++)
+      singleSetImplicitOPH(K[i], l, N);
+  }
+
   cout << "DSS" << endl;
 
 #pragma omp parallel for collapse(2)
@@ -168,6 +225,11 @@ void experiment4()
     for (int n = 0; n < n_tests; n++)
       testKLMinhashQuery(l, size, n_query, K[i], tree_buffer);
 
+#pragma omp parallel for collapse(2)
+  for (int i = 0; i < 6; i++)
+    for (int n = 0; n < n_tests; n++)
+      testOPHQuery(l, size, n_query, K[i]);
+
 #pragma omp parallel for collapse(2)
   for (int i = 0; i < 6; i++)
     for (int n = 0; n < n_tests; n++)
@@ -201,6 +263,11 @@ void experiment5()
     for (int n = 0; n < n_tests; n++)
       testKLMinhashUpdatesAndQuery(n_hashes, l, size, p[i], tree_buffer);
 
+#pragma omp parallel for collapse(2)
+  for (int i = 0; i < 15; i++)
+    for (int n = 0; n < n_tests; n++)
+      testOPHUpdatesAndQuery(n_hashes, l, size, p[i]);
+
 #pragma omp parallel for collapse(2)
   for (int i = 0; i < 15; i++)
     for (int n = 0; n < n_tests; n++)
@@ -244,15 +311,14 @@ void experiment6()
   int l = 17;
   int n_test = 100;
 
-  TabulationHash<uint32_t> **hashes = (TabulationHash<uint32_t> **)malloc((k * l) * sizeof(TabulationHash<uint32_t> *));
-  for (int i = 0; i < (k * l); i++)
-    hashes[i] = new TabulationHash<uint32_t>();
+  // all the k * l hash functions are stored contiguously, and shared by all the sketches
+  HashBank *bank = new HashBank(k * l);
 
   // PairWiseHash<uint32_t> *h1 = new PairWiseHash<uint32_t>();
   PairWiseHash<uint32_t> *h1 = new PairWiseHash<uint32_t>();
   PairWiseHash<uint32_t> *h2 = new PairWiseHash<uint32_t>(c);
 
-  cout << "sim,DMH,DSS,min_hash" << endl;
+  cout << "sim,DMH,DSS,min_hash,OPH" << endl;
 
   for (auto itr = params.begin(); itr != params.end(); itr++)
   {
@@ -263,15 +329,17 @@ void experiment6()
     double err_DMH = 0.0;
     double err_DSS = 0.0;
     double err_min_hash = 0.0;
+    double err_OPH = 0.0;
 
 #pragma omp parallel for // reduction(+ : err_DMH, err_DSS)
     for (int n = 0; n < n_test; n++)
     {
-      err_DMH = SE_DMH(k, l, U, p1, p2, (Hash<uint32_t> **)hashes);
-      err_DSS = SE_DSS(c, c, U, p1, p2, (Hash<uint32_t> **)hashes, (Hash<uint32_t> *)h1, (Hash<uint32_t> *)h2);
-      err_min_hash = SE_DMH(k * l, 1, U, p1, p2, (Hash<uint32_t> **)hashes);
+      err_DMH = SE_DMH(k, l, U, p1, p2, bank);
+      err_DSS = SE_DSS(c, c, U, p1, p2, bank->functions(), (Hash<uint32_t> *)h1, (Hash<uint32_t> *)h2);
+      err_min_hash = SE_DMH(k * l, 1, U, p1, p2, bank);
+      err_OPH = SE_OPH(k, l, U, p1, p2, bank->getSeed());
 
-      printf("%f, %f, %f, %f\n", j, err_DMH, err_DSS, err_min_hash);
+      printf("%f, %f, %f, %f, %f\n", j, err_DMH, err_DSS, err_min_hash, err_OPH);
     }
 
     // err_DMH = sqrt(err_DMH / (double)n_test);
@@ -347,9 +415,8 @@ void experiment7(std::string datasetName, double J, int b, int r, int m, int l)
   int k = b * r;
   int c = k;
 
-  TabulationHash<uint32_t> **hashes = (TabulationHash<uint32_t> **)malloc(k * sizeof(TabulationHash<uint32_t> *));
-  for (int i = 0; i < k; i++)
-    hashes[i] = new TabulationHash<uint32_t>();
+  // the k hash functions are stored contiguously, and shared by all the sketches
+  HashBank *bank = new HashBank(k);
 
   // PairWiseHash<uint32_t> *h1 = new PairWiseHash<uint32_t>();
   PairWiseHash<uint32_t> *h1 = new PairWiseHash<uint32_t>();
@@ -365,8 +432,8 @@ void experiment7(std::string datasetName, double J, int b, int r, int m, int l)
     set<int> *set = itr->second;
     int id = itr->first;
 
-    TreeKLMinhash *S1 = new TreeKLMinhash(k, 1, UINT32_MAX, (Hash<uint32_t> **)hashes, false);
-    DSS *S2 = new DSS(c, h1, h2, (Hash<uint32_t> **)hashes, k, false);
+    TreeKLMinhash *S1 = new TreeKLMinhash(k, 1, UINT32_MAX, bank, false);
+    DSS *S2 = new DSS(c, h1, h2, bank->functions(), k, false);
 
     for (auto el = set->begin(); el != set->end(); el++)
     {
@@ -392,24 +459,39 @@ void experiment7(std::string datasetName, double J, int b, int r, int m, int l)
   // compute LSH
   cout << endl
        << "Buffered Minhash:" << endl;
-  unordered_set<pair<int, int>, hash_pair> *candidatePairsBMH = computeLSH(signaturesBMH, n, r, b);
+  CandidatePairs *candidatePairsBMH = computeLSH(signaturesBMH, n, r, b);
   cout << endl
        << "DSS:" << endl;
-  unordered_set<pair<int, int>, hash_pair> *candidatePairsDSS = computeLSH(signaturesDSS, n, l, m);
+  CandidatePairs *candidatePairsDSS = computeLSH(signaturesDSS, n, l, m);
   cout << endl;
 
+  // all the pairs of the Buffered MinHash signatures whose estimated similarity is at least J, without LSH
+  SignatureBlock *blockBMH = new SignatureBlock(n, k);
+  for (int s = 0; s < n; s++)
+    blockBMH->set(s, signaturesBMH[s]);
+  AllPairs *allPairsBMH = new AllPairs(blockBMH);
+  allPairsBMH->run(J);
+
+  int TP_AP = 0;
+  for (vector<SimilarPair> &out : allPairsBMH->getPairs())
+    for (SimilarPair &p : out)
+      TP_AP += positiveMatrix[p.a][p.b] >= J;
+  int FP_AP = allPairsBMH->size() - TP_AP;
+  int FN_AP = effectivePositive - TP_AP;
+
   // cout << "Effective pairs:" << positive.size() << endl;
   cout << "Effective pairs:" << effectivePositive << endl;
   cout << "BMH pairs:" << candidatePairsBMH->size() << endl;
-  cout << "DSS pairs:" << candidatePairsDSS->size() << endl
+  cout << "DSS pairs:" << candidatePairsDSS->size() << endl;
+  cout << "BMH all pairs:" << allPairsBMH->size() << endl
        << endl;
 
   // compute statistics
   int TP_BMH = 0;
-  for (auto itr = candidatePairsBMH->begin(); itr != candidatePairsBMH->end(); itr++)
+  for (pair<int, int> p : *candidatePairsBMH)
   {
-    // TP_BMH += (positive.find({setIds[itr->first], setIds[itr->second]}) != positive.end()) || (positive.find({setIds[itr->second], setIds[itr->first]}) != positive.end());
-    TP_BMH += (positiveMatrix[itr->first][itr->second] >= J) || (positiveMatrix[itr->second][itr->first] >= J);
+    // TP_BMH += (positive.find({setIds[p.first], setIds[p.second]}) != positive.end()) || (positive.find({setIds[p.second], setIds[p.first]}) != positive.end());
+    TP_BMH += positiveMatrix[p.first][p.second] >= J;
   }
   int FP_BMH = candidatePairsBMH->size() - TP_BMH;
   // int FN_BMH = positive.size() - TP_BMH;
@@ -417,13 +499,13 @@ void experiment7(std::string datasetName, double J, int b, int r, int m, int l)
   int TN_BMH = (n * (n - 1) / 2) - TP_BMH - FP_BMH - FN_BMH;
 
   int TP_DSS = 0;
-  for (auto itr = candidatePairsDSS->begin(); itr != candidatePairsDSS->end(); itr++)
+  for (pair<int, int> p : *candidatePairsDSS)
   {
-    // if ((positive.find({setIds[itr->first], setIds[itr->second]}) != positive.end()) || (positive.find({setIds[itr->second], setIds[itr->first]}) != positive.end()))
+    // if ((positive.find({setIds[p.first], setIds[p.second]}) != positive.end()) || (positive.find({setIds[p.second], setIds[p.first]}) != positive.end()))
     // {
     //   TP_DSS++;
     // }
-    TP_DSS += (positiveMatrix[itr->first][itr->second] >= J) || (positiveMatrix[itr->second][itr->first] >= J);
+    TP_DSS += positiveMatrix[p.first][p.second] >= J;
   }
   int FP_DSS = candidatePairsDSS->size() - TP_DSS;
   // int FN_DSS = positive.size() - TP_DSS;
@@ -450,6 +532,460 @@ void experiment7(std::string datasetName, double J, int b, int r, int m, int l)
 
   cout << "Sorella" << endl;
   printf("Precision: %f\nRecall: %f\nAccuracy: %f\nError: %f\nF1: %f\n\n", precision_DSS, recall_DSS, accuracy_DSS, error_DSS, F1_DSS);
+
+  double precision_AP = ((double)TP_AP) / ((double)TP_AP + FP_AP);
+  double recall_AP = ((double)TP_AP) / ((double)TP_AP + FN_AP);
+  cout << "Buffered MinHash (all pairs)" << endl;
+  printf("Precision: %f\nRecall: %f\n\n", precision_AP, recall_AP);
+
+  delete allPairsBMH;
+  delete blockBMH;
+}
+
+/**
+ * This experiment finds the crossover between the tree (sorted) and the array (unsorted) buffers of Buffered MinHash (BMH):
+ * both variants run the workload of experiment1 on the same values of k, for l up to 1000.
+ */
+void experiment8()
+{
+  int K[2] = {100, 1000};
+  int L[12] = {1, 4, 8, 16, 32, 64, 96, 128, 192, 256, 512, 1000};
+  int N = 1 << 18;
+  int n_tests = 5;
+
+  for (int n = 0; n < n_tests; n++)
+  {
+    for (int i = 0; i < 2; i++)
+    {
+      for (int j = 0; j < 12; j++)
+      {
+        singleSetImplicit(K[i], L[j], N, true);
+        singleSetImplicit(K[i], L[j], N, false);
+      }
+    }
+  }
+}
+
+/**
+ * This experiment evaluates the scalability of the row-partitioned Buffered MinHash (BMH) on a single large sketch:
+ * the workload of experiment1 is applied in batches, with 1, 2, 4, ... worker threads (up to the number of cores).
+ */
+void experiment9()
+{
+  int K[2] = {1000, 2000};
+  int L[3] = {10, 50, 100};
+  int N = 1 << 20;
+  int batch = 1024;
+  int n_tests = 5;
+  int cores = max(1u, std::thread::hardware_concurrency());
+
+  for (int n = 0; n < n_tests; n++)
+  {
+    for (int i = 0; i < 2; i++)
+    {
+      for (int j = 0; j < 3; j++)
+      {
+        for (int t = 1; t <= cores; t *= 2)
+          singleSetImplicitParallel(K[i], L[j], N, batch, t, true);
+      }
+    }
+  }
+}
+
+/**
+ * This experiment compares the cost of the recovery of Buffered MinHash (BMH) with an explicit set,
+ * when all the rows are rebuilt after a fault and when only the rows that get empty are rebuilt.
+ */
+void experiment10()
+{
+  int K[3] = {100, 1000, 2000};
+  int L[4] = {1, 5, 10, 50};
+  int N = 1 << 16;
+  int n_tests = 5;
+
+  for (int n = 0; n < n_tests; n++)
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      for (int j = 0; j < 4; j++)
+      {
+        singleSetExplicitRecovery(K[i], L[j], N, false, true);
+        singleSetExplicitRecovery(K[i], L[j], N, true, true);
+      }
+    }
+  }
+}
+
+/**
+ * This experiment compares the tail latency of the updates of Buffered MinHash (BMH) with an explicit set,
+ * with synchronous recovery and with incremental recovery (reinserting 1, 4, 16 or 64 elements at each update).
+ */
+void experiment11()
+{
+  int K[2] = {100, 1000};
+  int L[2] = {5, 50};
+  int S[5] = {0, 1, 4, 16, 64};
+  int N = 1 << 18;
+  int n_tests = 5;
+
+  for (int n = 0; n < n_tests; n++)
+  {
+    for (int i = 0; i < 2; i++)
+    {
+      for (int j = 0; j < 2; j++)
+      {
+        for (int s = 0; s < 5; s++)
+          singleSetExplicitLatency(K[i], L[j], N, S[s], true);
+      }
+    }
+  }
+}
+
+/**
+ * This experiment compares the stores of the explicit set used for the recovery (memory and throughput),
+ * on small and large, sparse (random 32-bit) and dense (e.g. vertex ids) sets.
+ */
+void experiment12()
+{
+  // the small sets show the footprint of a store per sketch
+  int N[4] = {1 << 8, 1 << 16, 1 << 20, 1 << 23};
+
+  for (int i = 0; i < 4; i++)
+  {
+    uint32_t ranges[2] = {UINT32_MAX, (uint32_t)(2 * N[i])};
+    for (int j = 0; j < 2; j++)
+    {
+      testRecoveryStore(new HashSetStore(), "unordered_set", N[i], ranges[j]);
+      testRecoveryStore(new FlatHashStore(), "flat-hash", N[i], ranges[j]);
+      testRecoveryStore(new BitmapStore(), "bitmap", N[i], ranges[j]);
+    }
+  }
+}
+
+/**
+ * This experiment evaluates the hash memo on the sliding window model (explicit set):
+ * the recovery by rehashing the set (c = 0) against the recovery from memos of growing size (c buffers for each row).
+ */
+void experiment13()
+{
+  int K[2] = {100, 1000};
+  int L[2] = {1, 5};
+  double C[5] = {0, 1, 2, 4, 8};
+  int W = 10000;
+  int N = 1 << 16;
+  int n_tests = 5;
+
+  for (int n = 0; n < n_tests; n++)
+  {
+    for (int i = 0; i < 2; i++)
+    {
+      for (int j = 0; j < 2; j++)
+      {
+        for (int c = 0; c < 5; c++)
+        {
+          slidingWindowMinHashMemo(K[i], L[j], N, W, C[c], true);
+          slidingWindowMinHashMemo(K[i], L[j], N, W, C[c], false);
+        }
+      }
+    }
+  }
+}
+
+/**
+ * This experiment evaluates the persistence of a store of sketches: writing it, opening it with a memory mapping,
+ * querying the mapping and loading the sketches from a stream, then checks that malformed records are rejected on load.
+ */
+void experiment14()
+{
+  int N[3] = {10000, 100000, 1000000};
+  int K[2] = {64, 128};
+  int l = 4;
+
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 2; j++)
+      testSerialization(N[i], K[j], l, 100, "sketches.bin");
+  }
+
+  // malformed records must be rejected by load
+  for (int j = 0; j < 2; j++)
+    testCorruptRecords(K[j], l, 100);
+}
+
+/**
+ * This experiment compares the serial construction of a sketch with the parallel one (partition and tree reduction by merge).
+ */
+void experiment15()
+{
+  int K[2] = {100, 1000};
+  int L[2] = {5, 50};
+  int T[5] = {1, 2, 4, 8, 16};
+  int N = 1 << 22;
+  int n_tests = 5;
+
+  for (int n = 0; n < n_tests; n++)
+  {
+    for (int i = 0; i < 2; i++)
+    {
+      for (int j = 0; j < 2; j++)
+      {
+        for (int t = 0; t < 5; t++)
+        {
+          testParallelBuild(K[i], L[j], N, T[t], true);
+          testParallelBuild(K[i], L[j], N, T[t], false);
+        }
+      }
+    }
+  }
+}
+
+/**
+ * This experiment compares the sketches with a single hash function per update (one permutation hashing and bottom-k)
+ * with Buffered MinHash (k hash functions per update): throughput on the same workload, and quality of the similarity estimation.
+ */
+void experiment16()
+{
+  int N = 1 << 16;
+  int K[6] = {64, 128, 256, 512, 1024, 2048};
+  int l = 32;
+  int n_tests = 10;
+
+  cout << "sketch,k,l,N,faults,time" << endl;
+
+  for (int i = 0; i < 6; i++)
+  {
+    for (int n = 0; n < n_tests; n++)
+    {
+      singleSetImplicit(K[i], l, N, true);
+      singleSetImplicitOPH(K[i], l, N);
+      singleSetImplicitBottomK(K[i], l, N);
+    }
+  }
+
+  // the probabilities of the synthetic dataset for the similarities 0.1, 0.5 and 0.9 (see experiment6)
+  float J[3] = {0.1, 0.5, 0.9};
+  float P1[3] = {0.8183, 0.329, 0.0487};
+  float P2[3] = {0.043, 0.018, 0.003};
+  int U = 1 << 17;
+  int k = 1024;
+
+  cout << "sim,DMH,OPH,bottom_k" << endl;
+
+  HashBank *bank = new HashBank(k);
+  for (int j = 0; j < 3; j++)
+  {
+    for (int n = 0; n < n_tests; n++)
+    {
+      double err_DMH = SE_DMH(k, l, U, P1[j], P2[j], bank);
+      double err_OPH = SE_OPH(k, l, U, P1[j], P2[j], bank->getSeed());
+      double err_bottom_k = SE_BottomK(k, l, U, P1[j], P2[j], bank->getSeed());
+
+      printf("%f, %f, %f, %f\n", J[j], err_DMH, err_OPH, err_bottom_k);
+    }
+  }
+  delete bank;
+}
+
+/**
+ * This experiment evaluates the b-bit signatures (b in {1, 2, 4, 8, 16}) against the full signatures:
+ * memory and throughput of the one-vs-all comparisons, and quality of the bias-corrected similarity estimation.
+ */
+void experiment17()
+{
+  int B[5] = {1, 2, 4, 8, 16};
+  int k = 1024;
+  int n_sketches = 1000;
+  int size = 1000;
+  int n_query = 100;
+  int n_tests = 10;
+
+  cout << "signature,k,b,n_sketches,n_query,bytes,time,avg_sim" << endl;
+
+  for (int i = 0; i < 5; i++)
+    testBBitQuery(k, B[i], n_sketches, size, n_query);
+
+  // the probabilities of the synthetic dataset for the similarities 0.1, 0.5 and 0.9 (see experiment6)
+  float J[3] = {0.1, 0.5, 0.9};
+  float P1[3] = {0.8183, 0.329, 0.0487};
+  float P2[3] = {0.043, 0.018, 0.003};
+  int U = 1 << 17;
+  int l = 32;
+
+  cout << "sim,b,DMH,b_bit" << endl;
+
+  HashBank *bank = new HashBank(k);
+  for (int j = 0; j < 3; j++)
+  {
+    for (int i = 0; i < 5; i++)
+    {
+      for (int n = 0; n < n_tests; n++)
+      {
+        double err_DMH = SE_DMH(k, l, U, P1[j], P2[j], bank);
+        double err_b_bit = SE_BBit(k, l, U, P1[j], P2[j], bank, B[i]);
+
+        printf("%f, %d, %f, %f\n", J[j], B[i], err_DMH, err_b_bit);
+      }
+    }
+  }
+  delete bank;
+}
+
+/**
+ * This experiment evaluates the throughput of the one-vs-many similarity queries, with the scalar loop and with the SIMD kernel,
+ * on blocks of signatures that fit in the cache and on blocks that do not (about 100 MB).
+ */
+void experiment18()
+{
+  int K[4] = {64, 128, 256, 1024};
+  int N[2] = {1000, 100000};
+  int n_tests = 5;
+
+  cout << "kernel,k,n_signatures,n_query,time,GB/s,avg_sim" << endl;
+
+  for (int i = 0; i < 4; i++)
+    for (int j = 0; j < 2; j++)
+      for (int n = 0; n < n_tests; n++)
+        testSimilarityQuery(K[i], N[j] * 1024 / K[i], N[j] == 1000 ? 1000 : 10);
+}
+
+/**
+ * This experiment evaluates the all-pairs similarity engine (tiled, on all the cores) against the loop over all the pairs,
+ * up to the target size of 10^5 signatures with k = 1024.
+ */
+void experiment19()
+{
+  int N[4] = {1000, 10000, 30000, 100000};
+  int k = 1024;
+  double J = 0.5;
+
+  cout << "engine,k,n_signatures,tile,J,pairs,time,GB/s" << endl;
+
+  for (int i = 0; i < 4; i++)
+    testAllPairs(k, N[i], J, 0.8, N[i] <= 10000);
+}
+
+/**
+ * This experiment compares the LSH candidate generation with the hash tables (computeLSH) and with the sort of the bands
+ * (computeLSHSorted) on different numbers of threads, on n random signatures with b = 300 bands of r = 3 values,
+ * where every signature shares about half of its values with the previous one.
+ */
+void experiment20()
+{
+  int n = 100000;
+  int b = 300;
+  int r = 3;
+  int k = b * r;
+  int T[4] = {1, 2, 4, 8};
+  int n_tests = 5;
+
+  uint32_t **signatures = (uint32_t **)malloc(sizeof(uint32_t *) * n);
+  for (int i = 0; i < n; i++)
+  {
+    signatures[i] = new uint32_t[k];
+    for (int j = 0; j < k; j++)
+      signatures[i][j] = i == 0 || rand() % 2 == 0 ? rand() : signatures[i - 1][j];
+  }
+
+  cout << "lsh,n,b,r,threads,pairs,time" << endl;
+
+  for (int t = 0; t < 4; t++)
+  {
+    omp_set_num_threads(T[t]);
+    for (int test = 0; test < n_tests; test++)
+    {
+      auto start = high_resolution_clock::now();
+      CandidatePairs *candidatePairs = computeLSH(signatures, n, r, b);
+      float time = (float)duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000000.0;
+      printf("hash, %d, %d, %d, %d, %zu, %f\n", n, b, r, T[t], candidatePairs->size(), time);
+      delete candidatePairs;
+
+      start = high_resolution_clock::now();
+      candidatePairs = computeLSHSorted(signatures, n, r, b);
+      time = (float)duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000000.0;
+      printf("sorted, %d, %d, %d, %d, %zu, %f\n", n, b, r, T[t], candidatePairs->size(), time);
+      delete candidatePairs;
+    }
+  }
+
+  for (int i = 0; i < n; i++)
+    delete[] signatures[i];
+  free(signatures);
+}
+
+/**
+ * This experiment evaluates the handling of the heavy LSH buckets on a skewed input: n random signatures (b = 300 bands of r = 3 values)
+ * where every signature shares about half of its values with the previous one, and 1% of the sets are empty
+ * (all their values are NUM_MAX), so that every band has a bucket of n / 100 elements.
+ * It compares no cap, the sampling and the split of the heavy buckets, and prints the statistics of the buckets of the first bands.
+ * Then it checks the split on a single heavy bucket (see testHeavyBuckets).
+ */
+void experiment21()
+{
+  int n = 50000;
+  int b = 300;
+  int r = 3;
+  int k = b * r;
+  int maxBucket = 100;
+
+  uint32_t **signatures = (uint32_t **)malloc(sizeof(uint32_t *) * n);
+  for (int i = 0; i < n; i++)
+  {
+    signatures[i] = new uint32_t[k];
+    for (int j = 0; j < k; j++)
+      signatures[i][j] = i % 100 == 0 ? NUM_MAX : (i == 0 || rand() % 2 == 0 ? rand() : signatures[i - 1][j]);
+  }
+
+  const char *names[3] = {"none", "sample", "split"};
+  cout << "heavy,n,b,r,max_bucket,pairs,time" << endl;
+
+  for (int policy = 0; policy < 3; policy++)
+  {
+    LSHStats stats;
+    LSHOptions options;
+    options.stats = &stats;
+    if (policy > 0)
+    {
+      options.maxBucket = maxBucket;
+      options.policy = policy == 1 ? HEAVY_SAMPLE : HEAVY_SPLIT;
+    }
+
+    auto start = high_resolution_clock::now();
+    CandidatePairs *candidatePairs = computeLSHSorted(signatures, n, r, b, options);
+    float time = (float)duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000000.0;
+    printf("%s, %d, %d, %d, %d, %zu, %f\n", names[policy], n, b, r, options.maxBucket, candidatePairs->size(), time);
+    delete candidatePairs;
+
+    if (policy == 0)
+      stats.print(cout, 5);
+  }
+
+  for (int i = 0; i < n; i++)
+    delete[] signatures[i];
+  free(signatures);
+
+  // the split must find the pairs of the heavy bucket that the sampling and the other bands miss
+  cout << "heavy,policy,n,b,r,extra,cluster,max_bucket,pairs,cluster_pairs,total_cluster_pairs,only_heavy,mismatches" << endl;
+  testHeavyBuckets(5000, 20, 3, 3, 50, maxBucket);
+  testHeavyBuckets(5000, 20, 3, 0, 50, maxBucket);
+}
+
+/**
+ * This experiment evaluates the dynamic LSH index under the updates of the sketches: the time of the updates of the sketches,
+ * of the index and of the queries of the candidates, against the time of a rebuild of the index from scratch.
+ */
+void experiment22()
+{
+  int N[3] = {1000, 10000, 50000};
+  int b = 50;
+  int r = 2;
+  int l = 8;
+  int size = 100;
+  int n_updates = 100000;
+
+  cout << "index,n_sets,b,r,updates,faults,moved,mismatches,candidates,queries,time,rebuild_time" << endl;
+
+  for (int i = 0; i < 3; i++)
+    testDynamicLSH(N[i], b, r, l, 20 * N[i], size, n_updates);
 }
 
 /**
@@ -0,0 +1,139 @@
+#ifndef ALLPAIRS_H
+#define ALLPAIRS_H
+
+#include <cstdint>
+#include <stdlib.h>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "Sketch.cpp"
+#include "Similarity.cpp"
+
+using namespace std;
+
+/**
+ * A pair of signatures (a < b) and the estimation of their jaccard similarity
+ */
+struct SimilarPair
+{
+    uint32_t a;
+    uint32_t b;
+    float similarity;
+};
+
+/**
+ * Computes the estimation of the jaccard similarity of all the pairs of signatures of a block (the upper triangle of the n x n matrix)
+ * and keeps only the pairs whose similarity is at least J, without materializing the matrix.
+ *
+ * The signatures are split in tiles of tile consecutive signatures, and the upper triangle in the tiles (I, J) with I <= J.
+ * A tile is about 128 KB, so that the column tile J stays in the L2 cache while it is compared (see compare::oneVsMany)
+ * with every signature of the row tile I, each one staying in the L1 cache during its one-vs-many query.
+ * The rows of tiles (a row tile I and all its column tiles J >= I) are distributed among the OpenMP threads, with a dynamic schedule
+ * since the first rows have more tiles, and every thread appends its pairs to its own output buffer.
+ */
+class AllPairs
+{
+private:
+    SignatureBlock *block;
+
+    /**
+     * tile: the number of signatures of a tile
+     */
+    size_t tile;
+
+    /**
+     * pairs: the output buffers, one for each thread
+     */
+    vector<vector<SimilarPair>> pairs;
+
+public:
+    /**
+     * Constructor
+     * If tile is 0, it is chosen so that a tile takes about 128 KB.
+     */
+    AllPairs(SignatureBlock *block, size_t tile = 0) : block(block), tile(tile)
+    {
+        if (this->tile == 0)
+        {
+            size_t bytes = ((size_t)block->getK() + 15) / 16 * 64;
+            this->tile = max((size_t)16, (size_t)(128 * 1024) / bytes);
+        }
+    }
+
+    /**
+     * Computes the pairs with similarity at least J. It returns the total number of pairs.
+     * The pairs are in the output buffers (see getPairs), in no particular order.
+     */
+    size_t run(double J)
+    {
+        size_t n = this->block->size();
+        size_t n_tiles = (n + this->tile - 1) / this->tile;
+
+#ifdef _OPENMP
+        this->pairs.assign(omp_get_max_threads(), vector<SimilarPair>());
+#else
+        this->pairs.assign(1, vector<SimilarPair>());
+#endif
+
+#pragma omp parallel
+        {
+#ifdef _OPENMP
+            vector<SimilarPair> &out = this->pairs[omp_get_thread_num()];
+#else
+            vector<SimilarPair> &out = this->pairs[0];
+#endif
+            vector<double> sim(this->tile);
+
+#pragma omp for schedule(dynamic, 1)
+            for (size_t I = 0; I < n_tiles; I++)
+            {
+                size_t rowEnd = min(n, (I + 1) * this->tile);
+                for (size_t Jt = I; Jt < n_tiles; Jt++)
+                {
+                    size_t colBegin = Jt * this->tile, colEnd = min(n, (Jt + 1) * this->tile);
+                    for (size_t i = I * this->tile; i < rowEnd; i++)
+                    {
+                        // on the diagonal tile only the pairs (i, j) with j > i
+                        size_t begin = I == Jt ? i + 1 : colBegin;
+                        if (begin >= colEnd)
+                            continue;
+
+                        this->block->query(this->block->get(i), sim.data(), begin, colEnd);
+                        for (size_t j = begin; j < colEnd; j++)
+                            if (sim[j - begin] >= J)
+                                out.push_back({(uint32_t)i, (uint32_t)j, (float)sim[j - begin]});
+                    }
+                }
+            }
+        }
+
+        return this->size();
+    }
+
+    /**
+     * Returns the output buffers, one for each thread
+     */
+    vector<vector<SimilarPair>> &getPairs()
+    {
+        return this->pairs;
+    }
+
+    /**
+     * Returns the number of pairs found by the last run
+     */
+    size_t size()
+    {
+        size_t total = 0;
+        for (vector<SimilarPair> &out : this->pairs)
+            total += out.size();
+        return total;
+    }
+
+    size_t getTile()
+    {
+        return this->tile;
+    }
+};
+
+#endif
@@ -2,310 +2,418 @@
 #define ARRAYKLMINHASH_H
 
 #include <cstdint>
-#include <iostream>
 #include <stdlib.h>
-#include <unordered_set>
-#include <bits/stdc++.h>
-#include "hash.cpp"
-#include "Sketch.cpp"
+#include "KLMinhash.cpp"
 
 using namespace std;
 
-class ArrayKLMinhash : public Sketch
+/**
+ * Every buffer is an unsorted array of l hash values, whose first size entries are valid.
+ * The scans of a buffer (search of a value, minimum and maximum) are performed with AVX-512 or AVX2 vectors,
+ * whose lanes after the size of the buffer are masked out.
+ *
+ * All the data of the sketch lives in a single 64-byte aligned arena (see allocate):
+ * - the delta array, read (16 rows per cache line) by the bank to reject the rows that are not updated;
+ * - the scratch space of the bank and the signature;
+ * - the k rows, each one 64-byte aligned: a header with the minimum and the size of the buffer, followed by the buffer.
+ * In this way an update touches one line of delta, and the first line of the rows it updates.
+ *
+ * The updates, the recovery, the hash memo and the serialization are implemented by BasicKLMinhash, on the primitives of the buffers below.
+ *
+ * The sketch is templated on the family H of its k hash functions.
+ * ArrayKLMinhash (i.e. BasicArrayKLMinhash<Hash<num>>) is the type-erased version, in which every hash evaluation is a virtual call.
+ * BasicArrayKLMinhash<TabulationHash<num>> or BasicArrayKLMinhash<PairWiseHash<num>> call the (final) hash functions directly,
+ * so that the compiler can inline them.
+ */
+template <class H = Hash<num>>
+class BasicArrayKLMinhash : public BasicKLMinhash<BasicArrayKLMinhash<H>, H>
 {
 private:
-    /**
-     * U: the maximum size of the set (aka the universe size)
-     */
-    num U;
+    typedef BasicKLMinhash<BasicArrayKLMinhash<H>, H> Base;
+    friend Base;
 
     /**
-     * k: number of hash functions and buffers in the signature
+     * Header of a row, stored just before its buffer
      */
-    int k;
+    struct RowHeader
+    {
+        num min;
+        num size;
+        num reserved[2];
+    };
 
     /**
-     * l: number of hash values for each buffer
+     * HEADER: the number of entries taken by the header of a row
      */
-    int l;
+    static const int HEADER = sizeof(RowHeader) / sizeof(num);
 
     /**
-     * buffers: the signature of the set.
-     * It represents a sequence of k buffers, each containing l elements.
+     * stride: HEADER + l rounded up to a multiple of 16 (64 bytes), i.e. the distance between two consecutive rows
      */
-    num *buffers;
-
-    int *buffers_size;
+    int stride;
 
     /**
-     * delta: the maximum value in each buffer
+     * rows: the signature of the set.
+     * It represents a sequence of k rows, each containing a header and a buffer of l elements:
+     * the i-th row starts at rows[i * stride].
      */
-    num *delta;
+    num *rows;
 
+public:
     /**
-     * hashes: array of k hash functions
+     * KIND: the kind of the records of the sketch (see Serialization.cpp)
      */
-    Hash<num> **hashes;
-
-    bool doFreeHashes = true;
+    static const uint32_t KIND = serialization::ARRAY;
 
-    /**
-     * signature: the minhash signature.
-     */
-    num *signature;
+    BasicArrayKLMinhash() {}
 
-    /**
-     * explicitSet: if true, the set is explicitly stored.
-     * TODO: it will be deleted in the future
-     */
-    bool explicitSet;
+    BasicArrayKLMinhash(int k, int l, num U, bool explicitSet = true)
+    {
+        new (this) BasicArrayKLMinhash(k, l, U, explicitSet, randomSeed());
+    }
 
     /**
-     * elements: the set
-     * TODO: it will be deleted in the future
+     * Constructor
+     * the k hash functions are derived from the seed, so that two sketches built with the same seed
+     * (even by different processes) use the same hash functions and their signatures can be compared.
      */
-    std::unordered_set<num> elements;
-
-public:
-    ArrayKLMinhash() : k(1), l(1), U(1) {}
-
-    ArrayKLMinhash(int k, int l, num U, bool explicitSet = true)
+    BasicArrayKLMinhash(int k, int l, num U, bool explicitSet, uint64_t seed)
     {
         // PairWiseHash<num> *hashes = new PairWiseHash<num>[k];
 
-        // PairWiseHash<num> **hashes = (PairWiseHash<num> **)malloc(k * sizeof(PairWiseHash<num> *));
-        TabulationHash<num> **hashes = (TabulationHash<num> **)malloc(k * sizeof(TabulationHash<num> *));
+        // the type-erased sketch uses tabulation hash functions, stored in its own bank
+        if constexpr (std::is_abstract<H>::value)
+        {
+            new (this) BasicArrayKLMinhash(k, l, U, new HashBank(k, seed), explicitSet);
+            this->doFreeBank = true;
+            return;
+        }
+
+        SplitMix64 rng(seed);
+        H **hashes = (H **)malloc(k * sizeof(H *));
         for (int i = 0; i < k; i++)
             // hashes[i] = new PairWiseHash<num>(U);
-            hashes[i] = new TabulationHash<num>();
+            hashes[i] = newHash<H, TabulationHash<num>>(UINT32_MAX, rng);
 
-        new (this) ArrayKLMinhash(k, l, U, (Hash<num> **)hashes, explicitSet, true);
+        new (this) BasicArrayKLMinhash(k, l, U, hashes, explicitSet, true);
+        this->seed = seed;
+        this->seeded = true;
     }
 
     /**
      * Constructor
+     * the sketch uses the first k hash functions of the bank, that can be shared with other sketches
      */
-    ArrayKLMinhash(int k, int l, num U, Hash<num> **hashes, bool explicitSet = true, bool doFreeHashes = false)
-        : k(k), l(l), U(U), hashes(hashes), explicitSet(explicitSet), doFreeHashes(doFreeHashes)
+    BasicArrayKLMinhash(int k, int l, num U, HashBank *bank, bool explicitSet = true)
     {
-        // this->hashes = new std::pair<num, num>[k];
-        this->buffers = (num *)malloc(k * l * sizeof(num));
-        this->buffers_size = (int *)malloc(k * sizeof(int));
-        this->delta = (num *)malloc(k * sizeof(num));
+        new (this) BasicArrayKLMinhash(k, l, U, (H **)nullptr, explicitSet, false);
+        this->bank = bank;
+        this->doFreeBank = false;
+    }
 
-        this->signature = (num *)malloc(this->k * sizeof(num));
+    /**
+     * Constructor
+     */
+    BasicArrayKLMinhash(int k, int l, num U, H **hashes, bool explicitSet = true, bool doFreeHashes = false)
+        : Base(k, l, U, hashes, explicitSet, doFreeHashes)
+    {
+        this->allocate();
 
         for (int i = 0; i < k; i++)
         {
-            // this->buffers[i] = new num[l];
-            this->buffers_size[i] = 0;
             this->delta[i] = NUM_MAX;
-
-            for (int j = 0; j < l; j++)
-                this->buffers[i * l + j] = NUM_MAX;
+            this->header(i)->min = NUM_MAX;
+            this->header(i)->size = 0;
 
             this->signature[i] = NUM_MAX;
         }
     }
 
-    ~ArrayKLMinhash()
+    /**
+     * Allocates the arena and sets the pointers to its sections.
+     * delta, hashValues and signature have padded(k) entries (bank->hashAll scans them with vector loads),
+     * and the padding of delta is set to zero, so that the padding rows are never selected.
+     */
+    void allocate()
     {
-        // for (int i = 0; i < k; i++)
-        // delete this->buffers[i];
-        delete[] this->buffers;
-        delete[] this->delta;
-        delete[] this->signature;
-        delete[] this->buffers_size;
-
-        if (doFreeHashes)
-        {
-            for (int i = 0; i < k; i++)
-                delete this->hashes[i];
+        int padded = HashBank::padded(this->k);
+        int maskSize = ((padded / 64 * sizeof(uint64_t) / sizeof(num)) + 15) & ~15;
+        this->stride = (HEADER + this->l + 15) & ~15;
+
+        size_t size = 3 * padded + maskSize + (size_t)this->k * this->stride;
+        this->arena = (num *)aligned_alloc(64, size * sizeof(num));
+        memset(this->arena, 0, 3 * padded * sizeof(num));
+
+        this->delta = this->arena;
+        this->hashValues = this->arena + padded;
+        this->signature = this->arena + 2 * padded;
+        this->rowMask = (uint64_t *)(this->arena + 3 * padded);
+        this->rows = this->arena + 3 * padded + maskSize;
+    }
 
-            delete[] this->hashes;
-        }
+    /**
+     * Returns the header of the i-th row
+     */
+    RowHeader *header(int i)
+    {
+        return (RowHeader *)(this->rows + (size_t)i * this->stride);
     }
 
     /**
-     * Computes the hash of x using the i-th hash function
+     * Returns the buffer of the i-th row
      */
-    num hash(num x, int i)
+    num *buffer(int i)
     {
-        return (*this->hashes[i])(x);
+        return this->rows + (size_t)i * this->stride + HEADER;
     }
 
-    void insert(num x)
+    /**
+     * Returns true if the i-th buffer is empty
+     */
+    bool isEmpty(int i)
     {
-        this->insert(x, true);
+        return this->header(i)->size == 0;
     }
 
     /**
-     * Inserts x into the sketch.
-     * If insertIntoSet is true (default) and isExplicitSet flag is true, x is also explicitaly stored.
+     * Returns the minimum of the i-th row, i.e. the i-th entry of the signature
      */
-    void insert(num x, bool insertIntoSet)
+    num getMin(int i)
     {
-        if (this->explicitSet && insertIntoSet)
-            this->elements.insert(x);
+        return this->header(i)->min;
+    }
 
-        for (int i = 0; i < this->k; i++)
+    /**
+     * Inserts the hash value h (with h <= delta[i]) into the i-th buffer.
+     */
+    void insertAt(int i, num h)
+    {
+        RowHeader *header = this->header(i);
+        num *buffer = this->buffer(i);
+        if (header->size < this->l)
         {
-            num h = hash(x, i);
-            // num h = x;
-            if (h > this->delta[i])
-                continue;
-
-            if (this->buffers_size[i] < this->l)
-            {
-                this->buffers[i * this->l + this->buffers_size[i]] = h;
-                this->buffers_size[i]++;
-            }
-            else
-            {
-                num current_max = this->delta[i];
-                for (int j = 0; j < this->l; j++)
-                {
-                    if (this->buffers[i * this->l + j] == current_max)
-                    {
-                        this->buffers[i * this->l + j] = h;
-                        break;
-                    }
-                }
-            }
-
-            if (this->buffers_size[i] == this->l)
-            {
-                num max = 0;
-                for (int j = 0; j < this->l; j++)
-                {
-                    if (this->buffers[i * this->l + j] > max)
-                    {
-                        max = this->buffers[i * this->l + j];
-                    }
-                }
-                this->delta[i] = max;
-            }
-
-            if (this->signature[i] > h)
-                this->signature[i] = h;
+            buffer[header->size] = h;
+            header->size++;
+        }
+        else
+        {
+            // h replaces the maximum of the buffer
+            buffer[rowFind(buffer, this->l, this->delta[i])] = h;
         }
+
+        if (header->size == this->l)
+            this->delta[i] = rowMax(buffer, this->l);
+
+        if (header->min > h)
+            header->min = h;
     }
 
     /**
-     * Removes x from the sketch.
-     * If a fault occurs:
-     * - the method returns true ArrayKLMinhash *A = new ArrayKLMinhash(k, l, U, hashes, false);
-     * - the buffer is reset
-     * - if the explicitSet flag is true, all the elements are reinserted
-     * The method returns false otherwise
+     * Removes the hash value h (with h <= delta[i]) from the i-th buffer, if present.
+     * Returns true if the buffer gets empty, i.e. if a fault occurs (the caller has to recover the sketch).
      */
-    bool remove(num x)
+    bool removeAt(int i, num h)
     {
-        if (this->explicitSet)
-            this->elements.erase(x);
+        RowHeader *header = this->header(i);
+        num *buffer = this->buffer(i);
 
-        for (int i = 0; i < this->k; i++)
+        // find the element to remove
+        int index_to_remove = rowFind(buffer, header->size, h);
+        if (index_to_remove == -1)
         {
-            num h = hash(x, i);
-            // num h = x;
-            if (h > this->delta[i])
-                continue;
-
-            // find the element to remove
-            int index_to_remove = -1;
-            for (int j = 0; j < this->buffers_size[i]; j++)
-            {
-                if (this->buffers[i * this->l + j] == h)
-                {
-                    index_to_remove = j;
-                    break;
-                }
-            }
-
-            if (index_to_remove == -1)
-            {
-                continue;
-            }
-
-            // remove the element
-            this->buffers[i * this->l + index_to_remove] = this->buffers[i * this->l + this->buffers_size[i] - 1];
-            // this->buffers[i * this->l + this->buffers_size[i] - 1] = NUM_MAX;
-            this->buffers_size[i]--;
-
-            // if the buffer is empty reset it and eventually recover the sketch
-            if (this->buffers_size[i] == 0)
-            {
-                this->resetBuffer();
-                if (this->explicitSet)
-                    this->fault();
-
-                return true;
-            }
-
-            // recover the minimum value if deleted
-            if (this->signature[i] == h)
-            {
-                num min = NUM_MAX;
-                for (int j = 0; j < this->buffers_size[i]; j++)
-                {
-                    if (this->buffers[i * this->l + j] < min)
-                    {
-                        min = this->buffers[i * this->l + j];
-                    }
-                }
-                this->signature[i] = min;
-            }
+            return false;
         }
 
+        // remove the element
+        buffer[index_to_remove] = buffer[header->size - 1];
+        header->size--;
+
+        // if the buffer is empty the sketch has to be recovered
+        if (header->size == 0)
+            return true;
+
+        // recover the minimum value if deleted
+        if (header->min == h)
+            header->min = rowMin(buffer, header->size);
+
         return false;
     }
 
+#if defined(__AVX512F__)
     /**
-     * Reinserts all the elements in the sketch.
+     * Returns the mask of the lanes of the vector starting at a[j] that are in [0, n)
      */
-    void fault()
+    static __mmask16 lanes(int j, int n)
     {
-        auto itr = this->elements.begin();
-        for (; itr != this->elements.end(); ++itr)
-            this->insert(*itr, false);
+        return n - j >= 16 ? (__mmask16)0xffff : (__mmask16)((1u << (n - j)) - 1);
     }
-
+#elif defined(__AVX2__)
     /**
-     * Returns the k-minhash signature
+     * Returns the vector whose lanes are all ones if they are in [0, n), for the vector starting at a[j]
      */
-    num *getSignature()
+    static __m256i lanes(int j, int n)
     {
-        // for (int i = 0; i < this->k; i++)
-        //     this->signature[i] = *this->buffers[i]->begin();
-        return this->signature;
+        return _mm256_cmpgt_epi32(_mm256_set1_epi32(n - j), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
     }
+#endif
 
     /**
-     * Static method that given two sketches (ArrayKLMinhash) A & B returns the estimation of their jaccard similarity.
+     * Returns the position of the first occurrence of h in the first n entries of the buffer a, or -1 if h is not found.
+     * The entries after the first n are never read.
      */
-    static double similarity(ArrayKLMinhash *A, ArrayKLMinhash *B)
+    static int rowFind(const num *a, int n, num h)
     {
-        num *sigA = A->getSignature();
-        num *sigB = B->getSignature();
+#if defined(__AVX512F__)
+        __m512i key = _mm512_set1_epi32(h);
+        for (int j = 0; j < n; j += 16)
+        {
+            __mmask16 m = lanes(j, n);
+            __mmask16 eq = _mm512_mask_cmpeq_epi32_mask(m, _mm512_maskz_loadu_epi32(m, a + j), key);
+            if (eq)
+                return j + __builtin_ctz(eq);
+        }
+#elif defined(__AVX2__)
+        __m256i key = _mm256_set1_epi32(h);
+        for (int j = 0; j < n; j += 8)
+        {
+            __m256i m = lanes(j, n);
+            __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_maskload_epi32((const int *)(a + j), m), key), m);
+            int found = _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+            if (found)
+                return j + __builtin_ctz(found);
+        }
+#else
+        for (int j = 0; j < n; j++)
+            if (a[j] == h)
+                return j;
+#endif
+        return -1;
+    }
 
-        int k = A->k;
-        double c = .0;
-        for (int i = 0; i < k; i++)
-            c += sigA[i] == sigB[i];
-        return c / static_cast<double>(k);
+    /**
+     * Returns the maximum of the first n entries (n >= 1) of the buffer a
+     */
+    static num rowMax(const num *a, int n)
+    {
+#if defined(__AVX512F__)
+        __m512i acc = _mm512_setzero_si512();
+        for (int j = 0; j < n; j += 16)
+            acc = _mm512_max_epu32(acc, _mm512_maskz_loadu_epi32(lanes(j, n), a + j));
+        return _mm512_reduce_max_epu32(acc);
+#elif defined(__AVX2__)
+        __m256i acc = _mm256_setzero_si256();
+        for (int j = 0; j < n; j += 8)
+            acc = _mm256_max_epu32(acc, _mm256_maskload_epi32((const int *)(a + j), lanes(j, n)));
+        acc = _mm256_max_epu32(acc, _mm256_permute2x128_si256(acc, acc, 1));
+        acc = _mm256_max_epu32(acc, _mm256_shuffle_epi32(acc, 0b01001110));
+        acc = _mm256_max_epu32(acc, _mm256_shuffle_epi32(acc, 0b10110001));
+        return _mm256_cvtsi256_si32(acc);
+#else
+        num res = 0;
+        for (int j = 0; j < n; j++)
+            if (a[j] > res)
+                res = a[j];
+        return res;
+#endif
     }
 
     /**
-     * Resets the buffer to default values.
+     * Returns the minimum of the first n entries (n >= 1) of the buffer a
      */
-    void resetBuffer()
+    static num rowMin(const num *a, int n)
     {
-        for (int i = 0; i < this->k; i++)
+#if defined(__AVX512F__)
+        __m512i acc = _mm512_set1_epi32(NUM_MAX);
+        for (int j = 0; j < n; j += 16)
+            acc = _mm512_min_epu32(acc, _mm512_mask_loadu_epi32(_mm512_set1_epi32(NUM_MAX), lanes(j, n), a + j));
+        return _mm512_reduce_min_epu32(acc);
+#elif defined(__AVX2__)
+        __m256i acc = _mm256_set1_epi32(NUM_MAX);
+        for (int j = 0; j < n; j += 8)
         {
-            this->delta[i] = NUM_MAX;
-            this->buffers_size[i] = 0;
-            this->signature[i] = NUM_MAX;
+            __m256i m = lanes(j, n);
+            acc = _mm256_min_epu32(acc, _mm256_or_si256(_mm256_maskload_epi32((const int *)(a + j), m), _mm256_xor_si256(m, _mm256_set1_epi32(-1))));
         }
+        acc = _mm256_min_epu32(acc, _mm256_permute2x128_si256(acc, acc, 1));
+        acc = _mm256_min_epu32(acc, _mm256_shuffle_epi32(acc, 0b01001110));
+        acc = _mm256_min_epu32(acc, _mm256_shuffle_epi32(acc, 0b10110001));
+        return _mm256_cvtsi256_si32(acc);
+#else
+        num res = NUM_MAX;
+        for (int j = 0; j < n; j++)
+            if (a[j] < res)
+                res = a[j];
+        return res;
+#endif
+    }
+
+    /**
+     * Copies the values of the i-th buffer, in increasing order, into values (l entries). Returns their number.
+     */
+    int rowValues(int i, num *values)
+    {
+        int n = this->header(i)->size;
+        memcpy(values, this->buffer(i), n * sizeof(num));
+        sort(values, values + n);
+        return n;
+    }
+
+    /**
+     * Replaces the i-th buffer with the n values (n <= l, sorted in increasing order). delta is set by the caller.
+     */
+    void setRow(int i, const num *values, int n)
+    {
+        memcpy(this->buffer(i), values, n * sizeof(num));
+        this->header(i)->size = n;
+        this->header(i)->min = n > 0 ? values[0] : NUM_MAX;
+    }
+
+    /**
+     * Writes the i-th row in a record: its minimum, its size and its buffer (l values)
+     */
+    void saveRow(SketchRecordWriter &writer, int i)
+    {
+        // the entries after the size of the buffer are not meaningful, they are saved as NUM_MAX
+        RowHeader *header = this->header(i);
+        writer.write(header->min);
+        writer.write(header->size);
+        writer.write(this->buffer(i), header->size);
+        for (int j = header->size; j < this->l; j++)
+            writer.write(NUM_MAX);
+    }
+
+    /**
+     * Reads the i-th row from a record (see saveRow), whose delta has already been set.
+     * Returns false if the row is malformed: the size must be at most l, the minimum must be the one of the buffer,
+     * and a full buffer must hold delta (the value that insertAt replaces).
+     */
+    bool loadRow(SketchView &view, int i)
+    {
+        RowHeader *header = this->header(i);
+        num *buffer = this->buffer(i);
+        num size = view.row(i, 1);
+        if (size > (num)this->l)
+            return false;
+
+        header->min = view.row(i, 0);
+        header->size = size;
+        for (int j = 0; j < (int)size; j++)
+            buffer[j] = view.row(i, 2 + j);
+
+        if (header->min != (size > 0 ? rowMin(buffer, size) : NUM_MAX))
+            return false;
+        return (int)size < this->l || rowMax(buffer, size) == this->delta[i];
+    }
+
+    /**
+     * Resets the i-th row to default values.
+     */
+    void resetRow(int i)
+    {
+        this->delta[i] = NUM_MAX;
+        this->header(i)->min = NUM_MAX;
+        this->header(i)->size = 0;
+        this->signature[i] = NUM_MAX;
     }
 
     /**
@@ -323,25 +431,18 @@ public:
         else
             cout << "[" << current_max << "]\t";
 
-        for (int j = 0; j < this->buffers_size[i]; j++)
+        for (int j = 0; j < (int)this->header(i)->size; j++)
         {
-            if (this->buffers[i * this->l + j] == NUM_MAX)
+            if (this->buffer(i)[j] == NUM_MAX)
                 cout << start << "∞" << end << " ";
             else
-                cout << start << this->buffers[i * this->l + j] << end << " ";
+                cout << start << this->buffer(i)[j] << end << " ";
         }
 
         cout << endl;
     }
-
-    /**
-     * Prints the signature matrix.
-     */
-    void print()
-    {
-        for (int i = 0; i < this->k; i++)
-            this->printRow(i);
-    }
 };
 
+typedef BasicArrayKLMinhash<Hash<num>> ArrayKLMinhash;
+
 #endif
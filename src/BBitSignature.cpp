@@ -0,0 +1,258 @@
+#ifndef BBITSIGNATURE_H
+#define BBITSIGNATURE_H
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <stdlib.h>
+#include <immintrin.h>
+#include "Sketch.cpp"
+
+using namespace std;
+
+/**
+ * Matrix of b-bit minwise hashing signatures (P. Li, A. C. König, "b-Bit Minwise Hashing", WWW 2010).
+ * Only the lowest b bits (b in {1, 2, 4, 8, 16}) of every value of a signature are kept: the k values of a signature are packed
+ * in a row of 64-bit words (64 / b values per word, the i-th value in the bits [b * (i % (64 / b)), b * (i % (64 / b) + 1)) of the word i / (64 / b)),
+ * and the rows are stored contiguously, every row padded to a multiple of 64 bytes.
+ * So a signature takes k * b / 8 bytes instead of the 4 * k bytes of getSignature.
+ *
+ * Two values that are different in the full signatures collide on their lowest b bits with probability about 2^-b,
+ * so the fraction of equal values overestimates the jaccard similarity: see similarity for the corrected estimator.
+ */
+class BBitSignatures
+{
+private:
+    /**
+     * n: the number of signatures (rows)
+     */
+    size_t n;
+
+    /**
+     * k: the number of values of a signature
+     */
+    int k;
+
+    /**
+     * b: the number of bits kept for each value
+     */
+    int b;
+
+    /**
+     * rowWords: the number of 64-bit words of a row (a multiple of 8)
+     */
+    int rowWords;
+
+    /**
+     * words: the rows of the matrix, the r-th row starts at words[r * rowWords]
+     */
+    uint64_t *words;
+
+public:
+    /**
+     * Constructor
+     * The n rows are initialized to zero.
+     */
+    BBitSignatures(size_t n, int k, int b) : n(n), k(k), b(b)
+    {
+        this->rowWords = (int)((((size_t)k * b + 511) / 512) * 8);
+        this->words = (uint64_t *)aligned_alloc(64, this->n * this->rowWords * sizeof(uint64_t));
+        memset(this->words, 0, this->n * this->rowWords * sizeof(uint64_t));
+    }
+
+    ~BBitSignatures()
+    {
+        free(this->words);
+    }
+
+    /**
+     * Returns true if b is a supported number of bits (1, 2, 4, 8 or 16)
+     */
+    static bool supported(int b)
+    {
+        return b == 1 || b == 2 || b == 4 || b == 8 || b == 16;
+    }
+
+    /**
+     * Stores the lowest b bits of the k values of signature in the r-th row.
+     */
+    void set(size_t r, const num *signature)
+    {
+        uint64_t *row = this->row(r);
+        int perWord = 64 / this->b;
+        uint64_t mask = (1ull << this->b) - 1;
+
+        memset(row, 0, this->rowWords * sizeof(uint64_t));
+        for (int i = 0; i < this->k; i++)
+            row[i / perWord] |= (signature[i] & mask) << (this->b * (i % perWord));
+    }
+
+    /**
+     * Stores the signature of the sketch (TreeKLMinhash, ArrayKLMinhash, OPHKLMinhash, ...) in the r-th row.
+     */
+    template <class S>
+    void setSketch(size_t r, S *sketch)
+    {
+        this->set(r, sketch->getSignature());
+    }
+
+    /**
+     * Returns the r-th row
+     */
+    uint64_t *row(size_t r)
+    {
+        return this->words + r * this->rowWords;
+    }
+
+    /**
+     * Returns the i-th value (b bits) of the r-th row
+     */
+    num get(size_t r, int i)
+    {
+        int perWord = 64 / this->b;
+        uint64_t mask = (1ull << this->b) - 1;
+        return (num)((this->row(r)[i / perWord] >> (this->b * (i % perWord))) & mask);
+    }
+
+    size_t size()
+    {
+        return this->n;
+    }
+
+    int getK()
+    {
+        return this->k;
+    }
+
+    int getB()
+    {
+        return this->b;
+    }
+
+    int getRowWords()
+    {
+        return this->rowWords;
+    }
+
+    /**
+     * Returns the number of bytes of the matrix
+     */
+    size_t bytes()
+    {
+        return this->n * this->rowWords * sizeof(uint64_t);
+    }
+
+    /**
+     * Returns the number of different values of the two rows a and b of words words (a multiple of 8), with b bits for each value.
+     * The two rows are XORed, the bits of every value are ORed into its lowest bit (log2(b) shifts), and the lowest bits are counted:
+     * the padding values are zero in both rows, so they are never counted.
+     */
+    static int mismatches(const uint64_t *a, const uint64_t *b, int words, int bits)
+    {
+        // the lowest bit of every value of a word
+        uint64_t low = 0;
+        for (int i = 0; i < 64; i += bits)
+            low |= 1ull << i;
+
+        int count = 0;
+#if defined(__AVX512F__) && defined(__AVX512VPOPCNTDQ__)
+        __m512i m = _mm512_set1_epi64(low);
+        __m512i acc = _mm512_setzero_si512();
+        for (int w = 0; w < words; w += 8)
+        {
+            __m512i z = _mm512_xor_si512(_mm512_load_si512(a + w), _mm512_load_si512(b + w));
+            for (int s = 1; s < bits; s *= 2)
+                z = _mm512_or_si512(z, _mm512_srli_epi64(z, s));
+            acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(_mm512_and_si512(z, m)));
+        }
+        count = (int)_mm512_reduce_add_epi64(acc);
+#elif defined(__AVX2__)
+        // popcount of the bytes by a lookup of the two nibbles (vpshufb), summed by vpsadbw
+        const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+        __m256i m = _mm256_set1_epi64x(low);
+        __m256i acc = _mm256_setzero_si256();
+        for (int w = 0; w < words; w += 4)
+        {
+            __m256i z = _mm256_xor_si256(_mm256_load_si256((const __m256i *)(a + w)), _mm256_load_si256((const __m256i *)(b + w)));
+            for (int s = 1; s < bits; s *= 2)
+                z = _mm256_or_si256(z, _mm256_srli_epi64(z, s));
+            z = _mm256_and_si256(z, m);
+
+            __m256i c = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, _mm256_and_si256(z, nibble)),
+                                        _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(z, 4), nibble)));
+            acc = _mm256_add_epi64(acc, _mm256_sad_epu8(c, _mm256_setzero_si256()));
+        }
+        count = (int)(_mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) + _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3));
+#else
+        for (int w = 0; w < words; w++)
+        {
+            uint64_t z = a[w] ^ b[w];
+            for (int s = 1; s < bits; s *= 2)
+                z |= z >> s;
+            count += __builtin_popcountll(z & low);
+        }
+#endif
+        return count;
+    }
+
+    /**
+     * Returns the number of equal values of the rows r and s
+     */
+    int matches(size_t r, size_t s)
+    {
+        return this->k - mismatches(this->row(r), this->row(s), this->rowWords, this->b);
+    }
+
+    /**
+     * Returns the fraction of equal values of the rows r and s, i.e. the estimation of the probability that their b-bit values collide
+     */
+    double collision(size_t r, size_t s)
+    {
+        return this->matches(r, s) / static_cast<double>(this->k);
+    }
+
+    /**
+     * Returns the bias-corrected estimation of the jaccard similarity of the rows r and s (see estimate).
+     * The estimation is unbiased, so it can be (slightly) negative when the sets are (almost) disjoint.
+     */
+    double similarity(size_t r, size_t s, double r1 = 0, double r2 = 0)
+    {
+        return estimate(this->collision(r, s), this->b, r1, r2);
+    }
+
+    /**
+     * Returns the estimation of the jaccard similarity J from the collision probability P of the b-bit values (Theorem 1 of Li and König):
+     * P = C1 + (1 - C2) J, where C1 and C2 depend on the relative sizes r1 = |A| / D and r2 = |B| / D of the sets in the range D of the hash
+     * functions. If r1 = r2 = 0 (the default, e.g. 32-bit hash values and sets much smaller than 2^32) then C1 = C2 = 2^-b.
+     */
+    static double estimate(double P, int b, double r1 = 0, double r2 = 0)
+    {
+        double A1 = lowBitsCollision(r1, b);
+        double A2 = lowBitsCollision(r2, b);
+
+        double C1 = 1.0 / (1ull << b), C2 = C1;
+        if (r1 + r2 > 0)
+        {
+            C1 = A1 * r2 / (r1 + r2) + A2 * r1 / (r1 + r2);
+            C2 = A1 * r1 / (r1 + r2) + A2 * r2 / (r1 + r2);
+        }
+        return (P - C1) / (1 - C2);
+    }
+
+private:
+    /**
+     * Returns A(r) = r (1 - r)^(2^b - 1) / (1 - (1 - r)^(2^b)), the probability that the lowest b bits of the minimum of a set
+     * of relative size r are zero (its limit 2^-b for r -> 0)
+     */
+    static double lowBitsCollision(double r, int b)
+    {
+        double t = (double)(1ull << b);
+        if (r <= 0)
+            return 1.0 / t;
+        return r * pow(1 - r, t - 1) / (1 - pow(1 - r, t));
+    }
+};
+
+#endif
@@ -0,0 +1,264 @@
+#ifndef BOTTOMKMINHASH_H
+#define BOTTOMKMINHASH_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdlib.h>
+#include "hash.cpp"
+#include "Sketch.cpp"
+#include "RecoveryStore.cpp"
+#include "TreeKLMinhash.cpp"
+
+using namespace std;
+
+/**
+ * Buffered bottom-k sketch: a single hash function h, and a single sorted buffer of the k + l smallest values of h on the set.
+ * The signature is the k smallest values (the first k entries of the buffer), and the l extra values absorb the deletions,
+ * as the l values of a row of TreeKLMinhash: delta is the largest value that the buffer is guaranteed to hold,
+ * and a fault occurs when the buffer holds less than k values but has dropped some values (delta < NUM_MAX).
+ * An update costs a single hash evaluation and, if h(x) <= delta, a binary search and a shift of the buffer.
+ */
+class BottomKMinhash : public Sketch
+{
+private:
+    /**
+     * U: the maximum size of the set (aka the universe size)
+     */
+    num U;
+
+    /**
+     * k: the size of the signature
+     */
+    int k;
+
+    /**
+     * l: the number of extra values of the buffer
+     */
+    int l;
+
+    /**
+     * capacity: k + l, the size of the buffer
+     */
+    int capacity;
+
+    /**
+     * size: the number of values in the buffer
+     */
+    int size = 0;
+
+    /**
+     * hash: the hash function h
+     */
+    TabulationHash<num> *hash;
+
+    /**
+     * buffer: the smallest values of h on the set, in increasing order (padded with NUM_MAX)
+     */
+    num *buffer;
+
+    /**
+     * delta: the largest value held by the buffer
+     */
+    num delta;
+
+    /**
+     * explicitSet: if true, the set is explicitly stored
+     */
+    bool explicitSet;
+
+    /**
+     * elements: the set, stored only to recover the sketch after a fault (see setRecoveryStore)
+     */
+    RecoveryStore *elements = nullptr;
+
+    bool doFreeElements = true;
+
+public:
+    BottomKMinhash(int k, int l, num U, bool explicitSet = true)
+    {
+        new (this) BottomKMinhash(k, l, U, explicitSet, randomSeed());
+    }
+
+    /**
+     * Constructor
+     * h is derived from the seed, so that two sketches built with the same seed can be compared.
+     */
+    BottomKMinhash(int k, int l, num U, bool explicitSet, uint64_t seed) : U(U), k(k), l(l), explicitSet(explicitSet)
+    {
+        SplitMix64 rng(seed);
+        this->hash = new TabulationHash<num>(UINT32_MAX, rng);
+
+        this->capacity = k + l;
+        this->buffer = (num *)aligned_alloc(64, (((size_t)this->capacity + 15) & ~15) * sizeof(num));
+
+        this->elements = explicitSet ? new FlatHashStore() : nullptr;
+        this->doFreeElements = true;
+
+        this->resetBuffer();
+    }
+
+    ~BottomKMinhash()
+    {
+        free(this->buffer);
+        delete this->hash;
+        if (this->doFreeElements)
+            delete this->elements;
+    }
+
+    void insert(num x)
+    {
+        this->insert(x, true);
+    }
+
+    /**
+     * Inserts x into the sketch.
+     * If insertIntoSet is true (default) and isExplicitSet flag is true, x is also explicitaly stored.
+     */
+    void insert(num x, bool insertIntoSet)
+    {
+        if (this->explicitSet && insertIntoSet)
+            this->elements->insert(x);
+
+        num h = (*this->hash)(x);
+        if (h > this->delta)
+            return;
+
+        // the maximum (the last entry) is dropped, and the entries after h are shifted to the right
+        int j = TreeKLMinhash::upperBound(this->buffer, this->capacity - 1, h);
+        memmove(this->buffer + j + 1, this->buffer + j, (this->capacity - 1 - j) * sizeof(num));
+        this->buffer[j] = h;
+
+        if (this->size < this->capacity)
+            this->size++;
+        else
+            this->delta = this->buffer[this->capacity - 1];
+    }
+
+    /**
+     * Removes x from the sketch.
+     * If a fault occurs (the buffer holds less than k values, and it has dropped some values):
+     * - the method returns true
+     * - the buffer is reset
+     * - if the explicitSet flag is true, all the elements are reinserted
+     * The method returns false otherwise
+     */
+    bool remove(num x)
+    {
+        if (this->explicitSet)
+            this->elements->erase(x);
+
+        num h = (*this->hash)(x);
+        if (h > this->delta)
+            return false;
+
+        int j = TreeKLMinhash::upperBound(this->buffer, this->size, h);
+        if (j == 0 || this->buffer[j - 1] != h)
+            return false;
+
+        memmove(this->buffer + j - 1, this->buffer + j, (this->size - j) * sizeof(num));
+        this->buffer[--this->size] = NUM_MAX;
+
+        if (this->size >= this->k || this->delta == NUM_MAX)
+            return false;
+
+        this->resetBuffer();
+        if (this->explicitSet)
+            this->fault();
+
+        return true;
+    }
+
+    /**
+     * Reinserts all the elements in the sketch.
+     */
+    void fault()
+    {
+        this->elements->forEach([&](num x)
+                                { this->insert(x, false); });
+    }
+
+    /**
+     * Replaces the store of the set (by default a FlatHashStore, see RecoveryStore.cpp), copying the current elements into it.
+     * If doFree is true the store is deleted with the sketch.
+     */
+    void setRecoveryStore(RecoveryStore *store, bool doFree = false)
+    {
+        if (this->elements != nullptr)
+        {
+            this->elements->forEach([&](num x)
+                                    { store->insert(x); });
+            if (this->doFreeElements)
+                delete this->elements;
+        }
+
+        this->elements = store;
+        this->doFreeElements = doFree;
+        this->explicitSet = true;
+    }
+
+    /**
+     * Returns the bottom-k signature: the k smallest values of h on the set, in increasing order (padded with NUM_MAX if the set
+     * has less than k elements). It points to the buffer, so it is valid until the next update.
+     */
+    num *getSignature()
+    {
+        return this->buffer;
+    }
+
+    /**
+     * Static method that given two sketches (BottomKMinhash) A & B returns the estimation of their jaccard similarity:
+     * the fraction of the k smallest values of the union of the two signatures (i.e. the bottom-k of the union of the sets)
+     * that are in both signatures (i.e. that are hash values of elements of the intersection).
+     */
+    static double similarity(BottomKMinhash *A, BottomKMinhash *B)
+    {
+        const num *a = A->getSignature();
+        const num *b = B->getSignature();
+        int k = A->k;
+
+        int i = 0, j = 0, n = 0, c = 0;
+        while (n < k && (i < k || j < k))
+        {
+            num va = i < k ? a[i] : NUM_MAX;
+            num vb = j < k ? b[j] : NUM_MAX;
+            if (va == NUM_MAX && vb == NUM_MAX)
+                break;
+
+            c += va == vb;
+            i += va <= vb;
+            j += vb <= va;
+            n++;
+        }
+
+        return n > 0 ? c / static_cast<double>(n) : 1.0;
+    }
+
+    /**
+     * Resets the buffer to default values.
+     */
+    void resetBuffer()
+    {
+        this->delta = NUM_MAX;
+        this->size = 0;
+        for (int j = 0; j < this->capacity; j++)
+            this->buffer[j] = NUM_MAX;
+    }
+
+    /**
+     * Prints the buffer.
+     */
+    void print()
+    {
+        if (this->delta == NUM_MAX)
+            cout << "[∞]\t";
+        else
+            cout << "[" << this->delta << "]\t";
+
+        for (int j = 0; j < this->size; j++)
+            cout << this->buffer[j] << " ";
+        cout << endl;
+    }
+};
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef CANDIDATEPAIRS_H
+#define CANDIDATEPAIRS_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+/**
+ * Set of the candidate pairs (a, b), with a < b, of n elements.
+ * A pair is packed in a 64-bit key (a << 32 | b). The pairs are added by several threads, each one with its own buffer, and finalize
+ * sorts the buffers in parallel and merges them removing the duplicates. If n is small (n * n <= BITMAP_BITS) the pairs are instead
+ * set in a bitmap of n * n bits, shared by the threads (atomic or), that finalize scans.
+ * After finalize the set is a sorted array of keys: it is iterated in increasing order of (a, b), and contains is a binary search.
+ */
+class CandidatePairs
+{
+public:
+    /**
+     * BITMAP_BITS: the maximum size of the bitmap (32 MB)
+     */
+    static const uint64_t BITMAP_BITS = 1ull << 28;
+
+    /**
+     * Iterator on the pairs of the set (after finalize)
+     */
+    class iterator
+    {
+    private:
+        const uint64_t *p;
+
+    public:
+        typedef forward_iterator_tag iterator_category;
+        typedef pair<int, int> value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const pair<int, int> *pointer;
+        typedef pair<int, int> reference;
+
+        iterator(const uint64_t *p) : p(p) {}
+
+        pair<int, int> operator*() const
+        {
+            return {(int)(*this->p >> 32), (int)(uint32_t)*this->p};
+        }
+
+        iterator &operator++()
+        {
+            this->p++;
+            return *this;
+        }
+
+        bool operator==(const iterator &other) const { return this->p == other.p; }
+        bool operator!=(const iterator &other) const { return this->p != other.p; }
+    };
+
+private:
+    /**
+     * n: the number of elements
+     */
+    int n;
+
+    /**
+     * buffers: the keys added by every thread (not in the bitmap mode)
+     */
+    vector<vector<uint64_t>> buffers;
+
+    /**
+     * bitmap: the bit a * n + b is set iff the pair (a, b) has been added (only in the bitmap mode, nullptr otherwise)
+     */
+    uint64_t *bitmap = nullptr;
+
+    /**
+     * keys: the sorted keys of the pairs, computed by finalize
+     */
+    vector<uint64_t> keys;
+
+public:
+    /**
+     * Constructor of the set of pairs of n elements, added by at most n_threads threads (the ids 0, ..., n_threads - 1)
+     */
+    CandidatePairs(int n, int n_threads = 1) : n(n)
+    {
+        if ((uint64_t)n * n <= BITMAP_BITS)
+        {
+            size_t words = ((uint64_t)n * n + 63) / 64;
+            this->bitmap = (uint64_t *)calloc(words > 0 ? words : 1, sizeof(uint64_t));
+        }
+        else
+            this->buffers.resize(n_threads);
+    }
+
+    ~CandidatePairs()
+    {
+        free(this->bitmap);
+    }
+
+    /**
+     * Returns the key of the pair {a, b} (a != b)
+     */
+    static uint64_t key(int a, int b)
+    {
+        if (a > b)
+            swap(a, b);
+        return (uint64_t)a << 32 | (uint32_t)b;
+    }
+
+    /**
+     * Adds the pair {a, b} (a != b, in any order) from the thread thread
+     */
+    void add(int thread, int a, int b)
+    {
+        if (a > b)
+            swap(a, b);
+
+        if (this->bitmap != nullptr)
+        {
+            uint64_t bit = (uint64_t)a * this->n + b;
+            uint64_t mask = 1ull << (bit % 64);
+            // the pre-check (a relaxed atomic load, as the word is updated concurrently) avoids the write when the pair is already set
+            if ((__atomic_load_n(this->bitmap + bit / 64, __ATOMIC_RELAXED) & mask) == 0)
+                __atomic_fetch_or(this->bitmap + bit / 64, mask, __ATOMIC_RELAXED);
+        }
+        else
+            this->buffers[thread].push_back((uint64_t)a << 32 | (uint32_t)b);
+    }
+
+    /**
+     * Builds the sorted array of the distinct pairs. It must be called once, after all the pairs have been added.
+     */
+    void finalize()
+    {
+        if (this->bitmap != nullptr)
+        {
+            // the bits are scanned in increasing order of a * n + b, i.e. of (a, b)
+            size_t words = ((uint64_t)this->n * this->n + 63) / 64;
+            for (size_t w = 0; w < words; w++)
+            {
+                for (uint64_t m = this->bitmap[w]; m != 0; m &= m - 1)
+                {
+                    uint64_t bit = w * 64 + __builtin_ctzll(m);
+                    this->keys.push_back((bit / this->n) << 32 | (bit % this->n));
+                }
+            }
+            free(this->bitmap);
+            this->bitmap = nullptr;
+            return;
+        }
+
+        int n_buffers = (int)this->buffers.size();
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int t = 0; t < n_buffers; t++)
+        {
+            vector<uint64_t> &buffer = this->buffers[t];
+            sort(buffer.begin(), buffer.end());
+            buffer.erase(unique(buffer.begin(), buffer.end()), buffer.end());
+        }
+
+        // the sorted buffers are merged in pairs, log2(n_buffers) levels of parallel merges
+        for (int step = 1; step < n_buffers; step *= 2)
+        {
+#pragma omp parallel for schedule(dynamic, 1)
+            for (int t = 0; t < n_buffers - step; t += 2 * step)
+            {
+                vector<uint64_t> merged;
+                merged.reserve(this->buffers[t].size() + this->buffers[t + step].size());
+                set_union(this->buffers[t].begin(), this->buffers[t].end(), this->buffers[t + step].begin(), this->buffers[t + step].end(), back_inserter(merged));
+                this->buffers[t].swap(merged);
+                vector<uint64_t>().swap(this->buffers[t + step]);
+            }
+        }
+
+        if (n_buffers > 0)
+            this->keys.swap(this->buffers[0]);
+        this->buffers.clear();
+    }
+
+    /**
+     * Returns the number of distinct pairs (after finalize)
+     */
+    size_t size()
+    {
+        return this->keys.size();
+    }
+
+    /**
+     * Returns true if the pair {a, b} is in the set (after finalize)
+     */
+    bool contains(int a, int b)
+    {
+        return binary_search(this->keys.begin(), this->keys.end(), key(a, b));
+    }
+
+    iterator begin()
+    {
+        return iterator(this->keys.data());
+    }
+
+    iterator end()
+    {
+        return iterator(this->keys.data() + this->keys.size());
+    }
+
+    /**
+     * Returns the number of bytes of the set (after finalize)
+     */
+    size_t bytes()
+    {
+        return this->keys.capacity() * sizeof(uint64_t);
+    }
+};
+
+#endif
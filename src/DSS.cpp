@@ -17,8 +17,13 @@ using namespace std;
 
 /**
  * Implementation of Alg1 of ["Similarity Search for Dynamic Data Streams"](https://ieeexplore.ieee.org/abstract/document/8713878)
+ *
+ * The sketch is templated on the family H of h1, h2 and of the t minhash functions.
+ * DSS (i.e. BasicDSS<Hash<uint32_t>>) is the type-erased version, in which every hash evaluation is a virtual call.
+ * H must be a family with bounded range (e.g. PairWiseHash), since h2 maps the elements to {0, 1, ..., c-1}.
  */
-class DSS : public Sketch
+template <class H = Hash<uint32_t>>
+class BasicDSS : public Sketch
 {
 
 public:
@@ -50,7 +55,7 @@ public:
      *
      * h2 is a pairwise function |U| -> {0, 1, ..., c-1}. It is used to compute the column index of the signature matrix.
      */
-    Hash<uint32_t> *h1, *h2;
+    H *h1, *h2;
 
     /**
      * T: the signature matrix
@@ -65,7 +70,7 @@ public:
     /**
      * hashes: the t hash functions used to compute the t-minhash signature
      */
-    Hash<uint32_t> **hashes;
+    H **hashes;
 
     bool doFreeHashes = true;
 
@@ -78,23 +83,36 @@ public:
      * Constructor
      * it randomly generates the two hash functions h1 and h2 and the t hash functions used to compute the t-minhash signature
      */
-    DSS(uint32_t c, int t = 1)
+    BasicDSS(uint32_t c, int t = 1)
     {
-        PairWiseHash<uint32_t> *h1 = new PairWiseHash<uint32_t>();
-        PairWiseHash<uint32_t> *h2 = new PairWiseHash<uint32_t>(c);
+        new (this) BasicDSS(c, t, randomSeed());
+    }
+
+    /**
+     * Constructor
+     * h1, h2 and the t hash functions are derived from the seed, so that two sketches built with the same seed
+     * (even by different processes) use the same hash functions.
+     */
+    BasicDSS(uint32_t c, int t, uint64_t seed)
+    {
+        SplitMix64 rng(seed);
+
+        // the type-erased sketch uses PairWiseHash functions
+        H *h1 = newHash<H, PairWiseHash<uint32_t>>(UINT32_MAX, rng);
+        H *h2 = newHash<H, PairWiseHash<uint32_t>>(c, rng);
 
-        PairWiseHash<uint32_t> **hashes = (PairWiseHash<uint32_t> **)malloc(t * sizeof(PairWiseHash<uint32_t> *));
+        H **hashes = (H **)malloc(t * sizeof(H *));
         for (int i = 0; i < t; i++)
-            hashes[i] = new PairWiseHash<uint32_t>();
+            hashes[i] = newHash<H, PairWiseHash<uint32_t>>(UINT32_MAX, rng);
 
-        new (this) DSS(c, h1, h2, (Hash<uint32_t> **)hashes, t, true);
+        new (this) BasicDSS(c, h1, h2, hashes, t, true);
     }
 
     /**
      * Constructor
      */
-    DSS(uint32_t c, Hash<uint32_t> *h1, Hash<uint32_t> *h2, Hash<uint32_t> **hashes, int t, bool doFreeHashes = false)
-        : size(0), U(UINT32_MAX), c(c), h1(h1), h2(h2), hashes(hashes), t(t), doFreeHashes(doFreeHashes)
+    BasicDSS(uint32_t c, H *h1, H *h2, H **hashes, int t, bool doFreeHashes = false)
+        : U(UINT32_MAX), size(0), c(c), h1(h1), h2(h2), t(t), hashes(hashes), doFreeHashes(doFreeHashes)
     {
         k = (int)floor(log2(U)) + 1;
         this->T = (uint32_t **)malloc(k * sizeof(uint32_t *));
@@ -110,18 +128,18 @@ public:
         this->signature = (uint32_t *)malloc(t * sizeof(uint32_t));
     }
 
-    ~DSS()
+    ~BasicDSS()
     {
         for (int i = 0; i < this->k; i++)
-            delete[] this->T[i];
-        delete[] this->T;
-        delete[] this->signature;
+            free(this->T[i]);
+        free(this->T);
+        free(this->signature);
 
         if (this->doFreeHashes)
         {
             for (int i = 0; i < this->t; i++)
                 delete this->hashes[i];
-            delete[] this->hashes;
+            free(this->hashes);
             delete this->h1;
             delete this->h2;
         }
@@ -155,6 +173,17 @@ public:
         return false;
     }
 
+    /**
+     * Applies a batch of n updates: xs[i] is inserted if ops[i] > 0, and removed otherwise.
+     * The sketch never faults, so the method always returns false.
+     */
+    bool applyBatch(const uint32_t *xs, const int8_t *ops, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+            this->update(xs[i], ops[i] > 0 ? 1 : -1);
+        return false;
+    }
+
     /**
      * Update the sketch.
      * This method implements the insertion and deletion of an element in the sketch.
@@ -212,7 +241,7 @@ public:
     /**
      * Returns the Jaccard similarity estimation between two sketches A and B, given the parameters alpha and r.
      */
-    static float similarity(DSS *A, DSS *B, float alpha, float r)
+    static float similarity(BasicDSS *A, BasicDSS *B, float alpha, float r)
     {
         // the size of the sketches
         uint32_t sA = A->size;
@@ -251,4 +280,6 @@ public:
     }
 };
 
+typedef BasicDSS<Hash<uint32_t>> DSS;
+
 #endif
\ No newline at end of file
@@ -17,8 +17,13 @@ using namespace std;
 
 /**
  * Implementation of Alg1 of ["Similarity Search for Dynamic Data Streams"](https://ieeexplore.ieee.org/abstract/document/8713878)
+ *
+ * The sketch is templated on the family H of h1, h2 and of the t minhash functions.
+ * DSSProactive (i.e. BasicDSSProactive<Hash<uint32_t>>) is the type-erased version, in which every hash evaluation is a virtual call.
+ * H must be a family with bounded range (e.g. PairWiseHash), since h2 maps the elements to {0, 1, ..., c-1}.
  */
-class DSSProactive : public Sketch
+template <class H = Hash<uint32_t>>
+class BasicDSSProactive : public Sketch
 {
 public:
     /**
@@ -49,7 +54,7 @@ public:
      *
      * h2 is a pairwise function |U| -> {0, 1, ..., c-1}. It is used to compute the column index of the signature matrix.
      */
-    Hash<uint32_t> *h1, *h2;
+    H *h1, *h2;
 
     /**
      * T: the signature matrix
@@ -64,7 +69,7 @@ public:
     /**
      * hashes: the t hash functions used to compute the t-minhash signature
      */
-    Hash<uint32_t> **hashes;
+    H **hashes;
 
     bool doFreeHashes = true;
 
@@ -77,23 +82,36 @@ public:
      * Constructor
      * it randomly generates the two hash functions h1 and h2 and the t hash functions used to compute the t-minhash signature
      */
-    DSSProactive(uint32_t c, int t = 1)
+    BasicDSSProactive(uint32_t c, int t = 1)
     {
-        PairWiseHash<uint32_t> *h1 = new PairWiseHash<uint32_t>();
-        PairWiseHash<uint32_t> *h2 = new PairWiseHash<uint32_t>(c);
+        new (this) BasicDSSProactive(c, t, randomSeed());
+    }
+
+    /**
+     * Constructor
+     * h1, h2 and the t hash functions are derived from the seed, so that two sketches built with the same seed
+     * (even by different processes) use the same hash functions.
+     */
+    BasicDSSProactive(uint32_t c, int t, uint64_t seed)
+    {
+        SplitMix64 rng(seed);
+
+        // the type-erased sketch uses PairWiseHash functions
+        H *h1 = newHash<H, PairWiseHash<uint32_t>>(UINT32_MAX, rng);
+        H *h2 = newHash<H, PairWiseHash<uint32_t>>(c, rng);
 
-        PairWiseHash<uint32_t> **hashes = (PairWiseHash<uint32_t> **)malloc(t * sizeof(PairWiseHash<uint32_t> *));
+        H **hashes = (H **)malloc(t * sizeof(H *));
         for (int i = 0; i < t; i++)
-            hashes[i] = new PairWiseHash<uint32_t>(UINT32_MAX);
+            hashes[i] = newHash<H, PairWiseHash<uint32_t>>(UINT32_MAX, rng);
 
-        new (this) DSSProactive(c, h1, h2, (Hash<uint32_t> **)hashes, t, true);
+        new (this) BasicDSSProactive(c, h1, h2, hashes, t, true);
     }
 
     /**
      * Constructor
      */
-    DSSProactive(uint32_t c, Hash<uint32_t> *h1, Hash<uint32_t> *h2, Hash<uint32_t> **hashes, int t, bool doFreeHashes = false)
-        : size(0), U(UINT32_MAX), c(c), h1(h1), h2(h2), hashes(hashes), t(t), doFreeHashes(doFreeHashes)
+    BasicDSSProactive(uint32_t c, H *h1, H *h2, H **hashes, int t, bool doFreeHashes = false)
+        : U(UINT32_MAX), size(0), c(c), h1(h1), h2(h2), t(t), hashes(hashes), doFreeHashes(doFreeHashes)
     {
         k = (int)floor(log2(U)) + 1;
         this->T = (uint32_t **)malloc(k * sizeof(uint32_t *));
@@ -114,21 +132,21 @@ public:
         }
     }
 
-    ~DSSProactive()
+    ~BasicDSSProactive()
     {
         for (int i = 0; i < this->k; i++)
         {
-            delete[] this->T[i];
-            delete[] this->signatures[i];
+            free(this->T[i]);
+            free(this->signatures[i]);
         }
-        delete[] this->T;
-        delete[] this->signatures;
+        free(this->T);
+        free(this->signatures);
 
         if (this->doFreeHashes)
         {
             for (int i = 0; i < this->t; i++)
                 delete this->hashes[i];
-            delete[] this->hashes;
+            free(this->hashes);
             delete this->h1;
             delete this->h2;
         }
@@ -174,6 +192,18 @@ public:
      * If op is 1, the element is inserted, otherwise it is removed.
      */
     void update(uint32_t x, int op)
+    {
+        int row = this->updateCounters(x, op);
+        if (row >= 0)
+            this->computeSignatureAt(row);
+    }
+
+    /**
+     * Updates the counters of the signature matrix, and the signatures of the affected row if x is inserted in an empty cell.
+     * Returns the row whose signatures have to be recomputed (because the minimum of a signature has been deleted),
+     * or -1 if there is no such row.
+     */
+    int updateCounters(uint32_t x, int op)
     {
         int i = lsb((*this->h1)(x)); // row
         int j = (*this->h2)(x);
@@ -187,10 +217,7 @@ public:
             {
                 uint32_t h = (*this->hashes[kk])(j + i * this->c);
                 if (h == this->signatures[i][kk])
-                {
-                    this->computeSignatureAt(i);
-                    return;
-                }
+                    return i;
             }
         }
 
@@ -202,6 +229,30 @@ public:
                 this->signatures[i][kk] = min(h, this->signatures[i][kk]);
             }
         }
+
+        return -1;
+    }
+
+    /**
+     * Applies a batch of n updates: xs[i] is inserted if ops[i] > 0, and removed otherwise.
+     * The signatures of a row are recomputed at most once, at the end of the batch, even if several of their minimums are deleted.
+     * The sketch never faults, so the method always returns false.
+     */
+    bool applyBatch(const uint32_t *xs, const int8_t *ops, size_t n)
+    {
+        vector<bool> dirty(this->k, false);
+        for (size_t i = 0; i < n; i++)
+        {
+            int row = this->updateCounters(xs[i], ops[i] > 0 ? 1 : -1);
+            if (row >= 0)
+                dirty[row] = true;
+        }
+
+        for (int i = 0; i < this->k; i++)
+            if (dirty[i])
+                this->computeSignatureAt(i);
+
+        return false;
     }
 
     /**
@@ -244,7 +295,7 @@ public:
     /**
      * Returns the Jaccard similarity estimation between two sketches A and B, given the parameters alpha and r.
      */
-    static float similarity(DSSProactive *A, DSSProactive *B, float alpha, float r)
+    static float similarity(BasicDSSProactive *A, BasicDSSProactive *B, float alpha, float r)
     {
         // the size of the sketches
         uint32_t sA = A->size;
@@ -283,4 +334,6 @@ public:
     }
 };
 
+typedef BasicDSSProactive<Hash<uint32_t>> DSSProactive;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,265 @@
+#ifndef DYNAMICLSH_H
+#define DYNAMICLSH_H
+
+#include <cstdint>
+#include <stdlib.h>
+#include <vector>
+#include <unordered_map>
+#include "Sketch.cpp"
+#include "LSH.cpp"
+
+using namespace std;
+
+/**
+ * LSH index of a dynamic collection of sets, identified by the ids 0, 1, ..., maintained under the updates of their sketches.
+ * The signature of a set (b bands of r values, i.e. its first b * r entries) is split in b bands as in computeLSH, and the set is in the bucket
+ * of the fingerprint of each of its bands (see bandFingerprint). A collision of the fingerprints (with probability about 2^-64) only adds a candidate.
+ *
+ * When a sketch is updated, only the bands that contain a changed entry of the signature (the dirty rows of a TreeKLMinhash, see getDirtyRows)
+ * are read and hashed again, and the set is moved to the bucket of the new fingerprint only if the fingerprint has changed.
+ * A bucket is a vector of ids, and every set stores its position in the bucket of each band, so that it is removed in constant time
+ * (swapping it with the last id of the bucket). The candidates of a set are the other sets of its b buckets: they are found in time
+ * O(b + size of the buckets), without any rebuild of the index.
+ */
+class DynamicLSH
+{
+private:
+    /**
+     * b: the number of bands
+     */
+    int b;
+
+    /**
+     * r: the number of values of each band
+     */
+    int r;
+
+    /**
+     * buckets[j]: the buckets of the band j, by fingerprint
+     */
+    vector<unordered_map<uint64_t, vector<int>>> buckets;
+
+    /**
+     * keys[id * b + j]: the fingerprint of the band j of the set id
+     */
+    vector<uint64_t> keys;
+
+    /**
+     * positions[id * b + j]: the position of the set id in its bucket of the band j
+     */
+    vector<uint32_t> positions;
+
+    /**
+     * present[id]: true if the set id is in the index
+     */
+    vector<char> present;
+
+    /**
+     * stamps: the last query that has visited each set, to report every candidate once
+     */
+    vector<uint32_t> stamps;
+    uint32_t stamp = 0;
+
+    /**
+     * band: scratch space of a band
+     */
+    vector<num> band;
+
+    /**
+     * Inserts the set id in the bucket of the band j with the given fingerprint
+     */
+    void link(int id, int j, uint64_t key)
+    {
+        vector<int> &bucket = this->buckets[j][key];
+        this->keys[(size_t)id * this->b + j] = key;
+        this->positions[(size_t)id * this->b + j] = bucket.size();
+        bucket.push_back(id);
+    }
+
+    /**
+     * Removes the set id from its bucket of the band j
+     */
+    void unlink(int id, int j)
+    {
+        auto it = this->buckets[j].find(this->keys[(size_t)id * this->b + j]);
+        vector<int> &bucket = it->second;
+
+        // the last id of the bucket takes the place of id
+        uint32_t p = this->positions[(size_t)id * this->b + j];
+        int last = bucket.back();
+        bucket[p] = last;
+        this->positions[(size_t)last * this->b + j] = p;
+        bucket.pop_back();
+
+        if (bucket.empty())
+            this->buckets[j].erase(it);
+    }
+
+    /**
+     * Makes room for the set id
+     */
+    void reserve(int id)
+    {
+        if ((size_t)id < this->present.size())
+            return;
+
+        size_t n = max((size_t)id + 1, 2 * this->present.size());
+        this->keys.resize(n * this->b);
+        this->positions.resize(n * this->b);
+        this->present.resize(n, 0);
+        this->stamps.resize(n, 0);
+    }
+
+public:
+    /**
+     * Constructor of the index with b bands of r values (the sketches must have k >= b * r)
+     */
+    DynamicLSH(int b, int r) : b(b), r(r)
+    {
+        this->buckets.resize(b);
+        this->band.resize(r);
+    }
+
+    /**
+     * Inserts the set id, whose signature is signature (at least b * r values), in the index. If the set is already in the index, it is updated.
+     */
+    void add(int id, const num *signature)
+    {
+        this->reserve(id);
+        if (this->present[id])
+            this->remove(id);
+
+        for (int j = 0; j < this->b; j++)
+            this->link(id, j, bandFingerprint(signature + (size_t)j * this->r, this->r));
+        this->present[id] = 1;
+    }
+
+    /**
+     * Inserts the set id, summarized by the sketch, in the index, and clears the dirty rows of the sketch (see update).
+     */
+    template <class S>
+    void addSketch(int id, S *sketch)
+    {
+        this->add(id, sketch->getSignature());
+        sketch->clearDirtyRows();
+    }
+
+    /**
+     * Updates the set id (already in the index) after some updates of its sketch: only the bands with a dirty row (see TreeKLMinhash::getDirtyRows)
+     * are hashed again, and then the dirty rows are cleared.
+     * Returns the number of bands in which the set has changed bucket.
+     */
+    template <class S>
+    int update(int id, S *sketch)
+    {
+        const uint64_t *dirty = sketch->getDirtyRows();
+        int moved = 0;
+        int words = (this->b * this->r + 63) / 64;
+
+        for (int w = 0, last = -1; w < words; w++)
+        {
+            uint64_t m = dirty[w];
+            // the rows after the b bands are not indexed
+            if (w == words - 1 && (this->b * this->r) % 64 != 0)
+                m &= (1ull << ((this->b * this->r) % 64)) - 1;
+
+            for (; m != 0; m &= m - 1)
+            {
+                int j = (w * 64 + __builtin_ctzll(m)) / this->r;
+                if (j == last)
+                    continue;
+                last = j;
+
+                for (int t = 0; t < this->r; t++)
+                    this->band[t] = sketch->getMin(j * this->r + t);
+                moved += this->updateBand(id, j, this->band.data());
+            }
+        }
+
+        sketch->clearDirtyRows();
+        return moved;
+    }
+
+    /**
+     * Sets the band j of the set id (already in the index) to the r values of values.
+     * Returns true if the set has changed bucket.
+     */
+    bool updateBand(int id, int j, const num *values)
+    {
+        uint64_t key = bandFingerprint(values, this->r);
+        if (key == this->keys[(size_t)id * this->b + j])
+            return false;
+
+        this->unlink(id, j);
+        this->link(id, j, key);
+        return true;
+    }
+
+    /**
+     * Removes the set id from the index
+     */
+    void remove(int id)
+    {
+        if ((size_t)id >= this->present.size() || !this->present[id])
+            return;
+
+        for (int j = 0; j < this->b; j++)
+            this->unlink(id, j);
+        this->present[id] = 0;
+    }
+
+    /**
+     * Returns true if the set id is in the index
+     */
+    bool contains(int id)
+    {
+        return (size_t)id < this->present.size() && this->present[id];
+    }
+
+    /**
+     * Calls f(other) once for every candidate of the set id (in the index), i.e. every other set that shares a bucket with it.
+     */
+    template <class F>
+    void forEachCandidate(int id, F f)
+    {
+        // the stamps are reset when the counter wraps around
+        if (++this->stamp == 0)
+        {
+            fill(this->stamps.begin(), this->stamps.end(), 0);
+            this->stamp = 1;
+        }
+        this->stamps[id] = this->stamp;
+
+        for (int j = 0; j < this->b; j++)
+        {
+            for (int other : this->buckets[j].find(this->keys[(size_t)id * this->b + j])->second)
+            {
+                if (this->stamps[other] == this->stamp)
+                    continue;
+                this->stamps[other] = this->stamp;
+                f(other);
+            }
+        }
+    }
+
+    /**
+     * Returns the candidates of the set id (in the index)
+     */
+    vector<int> candidates(int id)
+    {
+        vector<int> result;
+        this->forEachCandidate(id, [&](int other)
+                               { result.push_back(other); });
+        return result;
+    }
+
+    /**
+     * Returns the size of the bucket of the band j of the set id (in the index)
+     */
+    size_t bucketSize(int id, int j)
+    {
+        return this->buckets[j].find(this->keys[(size_t)id * this->b + j])->second.size();
+    }
+};
+
+#endif
@@ -0,0 +1,389 @@
+#ifndef HASHBANK_H
+#define HASHBANK_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdlib.h>
+#include <immintrin.h>
+#include <map>
+#include <mutex>
+#include "hash.cpp"
+
+using namespace std;
+
+/**
+ * One of the k tabulation hash functions of a HashBank.
+ * It does not own its table: it reads the column of the (transposed) tables of the bank.
+ */
+class TabulationRow final : public Hash<uint32_t>
+{
+private:
+    /**
+     * column: the first entry of the function in the tables of the bank
+     */
+    const uint32_t *column;
+
+    /**
+     * stride: the distance between two consecutive entries of the function
+     */
+    int stride;
+
+public:
+    TabulationRow() : column(nullptr), stride(0) {}
+
+    TabulationRow(const uint32_t *column, int stride) : column(column), stride(stride) {}
+
+    uint32_t operator()(uint32_t x)
+    {
+        uint32_t res = 0;
+        for (int i = 0; i < 8; i++)
+            res ^= column[(i * 16 + ((x >> 4 * i) & 0b1111)) * stride];
+        return res;
+    }
+};
+
+/**
+ * Bank of k TabulationHash<uint32_t> functions, stored in a single 64-byte aligned allocation.
+ *
+ * The k tables T_0, ..., T_{k-1} (each one of 8 x 16 entries) are stored transposed (structure of arrays):
+ * the entry T_i[j][c] is at position (j * 16 + c) * stride + i.
+ * Once the element x is fixed, its 8 nibbles select 8 contiguous rows of length k, and the k hash values are just their xor.
+ * In this way hashAll performs 8 vector loads every 16 (AVX-512) or 8 (AVX2) functions, without any gather.
+ *
+ * stride is k rounded up to a multiple of 64, so that every word of the bitmask computed by hashAll covers 64 complete rows.
+ *
+ * A bank can be shared by reference by any number of sketches: a sketch with k' <= k rows uses the first k' functions.
+ * The banks built from an array of hash functions (see fromHashes) are cached, so that the sketches built on the same array share its tables.
+ */
+class HashBank
+{
+private:
+    /**
+     * table: the transposed tables, 8 * 16 rows of stride entries
+     */
+    uint32_t *table;
+
+    /**
+     * k: the number of hash functions
+     */
+    int k;
+
+    /**
+     * stride: k rounded up to a multiple of 64
+     */
+    int stride;
+
+    /**
+     * seed: the seed from which the k hash functions are derived (0 if they are copied from other functions)
+     * first: the index of the first function of the bank among the ones derived from the seed
+     * seeded: false if the functions are copied from other functions
+     */
+    uint64_t seed;
+    int first = 0;
+    bool seeded = false;
+
+    /**
+     * rows: the k hash functions, as Hash<uint32_t> objects
+     */
+    TabulationRow *rows;
+
+    Hash<uint32_t> **rowFunctions;
+
+    /**
+     * references: the number of sketches that use the bank, if it is in the cache of fromHashes (0 otherwise)
+     * key: the key of the bank in the cache
+     */
+    int references = 0;
+    pair<const void *, int> key;
+
+    /**
+     * Returns the cache of fromHashes: the banks, by address of the array of the hash functions and number of functions
+     */
+    static map<pair<const void *, int>, HashBank *> &cache()
+    {
+        static map<pair<const void *, int>, HashBank *> banks;
+        return banks;
+    }
+
+    static mutex &cacheLock()
+    {
+        static mutex lock;
+        return lock;
+    }
+
+    void allocate()
+    {
+        this->stride = padded(k);
+        this->table = (uint32_t *)aligned_alloc(64, 8 * 16 * this->stride * sizeof(uint32_t));
+
+        // only the padding is cleared, the k entries of every row are filled by the constructors
+        for (int r = 0; r < 8 * 16; r++)
+            memset(this->table + r * this->stride + k, 0, (this->stride - k) * sizeof(uint32_t));
+
+        this->rows = new TabulationRow[k];
+        this->rowFunctions = (Hash<uint32_t> **)malloc(k * sizeof(Hash<uint32_t> *));
+        for (int i = 0; i < k; i++)
+        {
+            this->rows[i] = TabulationRow(this->table + i, this->stride);
+            this->rowFunctions[i] = &this->rows[i];
+        }
+    }
+
+public:
+    /**
+     * Constructor
+     * it derives the k tabulation hash functions (with range [0, UINT32_MAX]) from the seed.
+     * The i-th function is the same as TabulationHash<uint32_t>(UINT32_MAX, rng), where rng is a SplitMix64
+     * with the same seed after i * 128 draws: the table is filled in its own order, directly from the n-th draw.
+     * If first is not zero the bank holds the functions first, ..., first + k - 1 derived from the seed,
+     * i.e. a slice of a larger bank with the same seed.
+     */
+    HashBank(int k, uint64_t seed, int first = 0) : k(k), seed(seed), first(first), seeded(true)
+    {
+        this->allocate();
+
+        for (int j = 0; j < 8; j++)
+            for (int c = 0; c < 16; c++)
+            {
+                uint32_t *row = this->table + (j * 16 + c) * this->stride;
+                for (int i = 0; i < k; i++)
+                    row[i] = (uint32_t)(SplitMix64::at(seed, (uint64_t)(first + i) * 128 + j * 16 + c) >> 32);
+            }
+    }
+
+    /**
+     * Constructor
+     * it randomly generates the k tabulation hash functions (with range [0, UINT32_MAX])
+     */
+    HashBank(int k)
+    {
+        new (this) HashBank(k, randomSeed());
+    }
+
+    /**
+     * Constructor
+     * it copies the tables of the given k hash functions
+     */
+    HashBank(TabulationHash<uint32_t> **hashes, int k) : k(k), seed(0)
+    {
+        this->allocate();
+
+        for (int i = 0; i < k; i++)
+            for (int j = 0; j < 8; j++)
+                for (int c = 0; c < 16; c++)
+                    this->table[(j * 16 + c) * this->stride + i] = hashes[i]->entry(j, c);
+    }
+
+    ~HashBank()
+    {
+        free(this->table);
+        delete[] this->rows;
+        free(this->rowFunctions);
+    }
+
+    /**
+     * Returns the bank of the given k hash functions, or nullptr if they are not all TabulationHash<uint32_t>.
+     * The tables are copied only once for each array of hash functions: the following calls with the same array (and k) return the same bank,
+     * so the sketches built on a shared array also share its bank. Every bank returned must be released (see release),
+     * and the hash functions must not change while the bank is in use.
+     */
+    template <class H>
+    static HashBank *fromHashes(H **hashes, int k)
+    {
+        for (int i = 0; i < k; i++)
+            if (dynamic_cast<TabulationHash<uint32_t> *>(static_cast<Hash<uint32_t> *>(hashes[i])) == nullptr)
+                return nullptr;
+
+        lock_guard<mutex> guard(cacheLock());
+        pair<const void *, int> key((const void *)hashes, k);
+        auto it = cache().find(key);
+        if (it != cache().end())
+        {
+            it->second->references++;
+            return it->second;
+        }
+
+        HashBank *bank = new HashBank((TabulationHash<uint32_t> **)hashes, k);
+        bank->references = 1;
+        bank->key = key;
+        cache()[key] = bank;
+        return bank;
+    }
+
+    /**
+     * Releases a bank owned by a sketch: a bank returned by fromHashes is deleted when its last user releases it,
+     * any other bank is deleted immediately.
+     */
+    static void release(HashBank *bank)
+    {
+        if (bank == nullptr)
+            return;
+
+        if (bank->references > 0)
+        {
+            lock_guard<mutex> guard(cacheLock());
+            if (--bank->references > 0)
+                return;
+            cache().erase(bank->key);
+        }
+        delete bank;
+    }
+
+    /**
+     * Returns k rounded up to a multiple of 64, i.e. the number of entries of the arrays passed to hashAll
+     */
+    static int padded(int k)
+    {
+        return (k + 63) & ~63;
+    }
+
+    /**
+     * Returns the number of hash functions
+     */
+    int size()
+    {
+        return this->k;
+    }
+
+    /**
+     * Returns the seed of the hash functions
+     */
+    uint64_t getSeed()
+    {
+        return this->seed;
+    }
+
+    /**
+     * Returns the index of the first function of the bank among the ones derived from the seed
+     */
+    int getFirst()
+    {
+        return this->first;
+    }
+
+    /**
+     * Returns true if the functions are derived from the seed (see getSeed and getFirst), false if they are copied
+     */
+    bool isSeeded()
+    {
+        return this->seeded;
+    }
+
+    /**
+     * Returns true if the first n functions of this bank and of other are the same (their tables are compared)
+     */
+    bool sameFunctions(HashBank *other, int n)
+    {
+        if (this == other)
+            return true;
+
+        for (int r = 0; r < 8 * 16; r++)
+            if (memcmp(this->table + (size_t)r * this->stride, other->table + (size_t)r * other->stride, n * sizeof(uint32_t)) != 0)
+                return false;
+        return true;
+    }
+
+    /**
+     * Computes the hash of x using the i-th hash function
+     */
+    uint32_t hash(int i, uint32_t x)
+    {
+        return this->rows[i](x);
+    }
+
+    /**
+     * Returns the k hash functions as an array of Hash<uint32_t>, e.g. to build a DSS sketch on them
+     */
+    Hash<uint32_t> **functions()
+    {
+        return this->rowFunctions;
+    }
+
+    /**
+     * Sets t[j] to the row of the tables selected by the j-th nibble of x
+     */
+    void select(uint32_t x, const uint32_t **t)
+    {
+        for (int j = 0; j < 8; j++)
+            t[j] = this->table + (j * 16 + ((x >> 4 * j) & 0b1111)) * this->stride;
+    }
+
+    /**
+     * Computes the 64 hash values of the word w from the rows t selected by the element (see hashWord)
+     */
+    uint64_t hashWord(const uint32_t **t, int w, const uint32_t *delta, uint32_t *h)
+    {
+        uint64_t m = 0;
+#if defined(__AVX512F__)
+        for (int v = 0; v < 4; v++)
+        {
+            int i = w * 64 + v * 16;
+            __m512i acc = _mm512_xor_si512(_mm512_load_si512(t[0] + i), _mm512_load_si512(t[1] + i));
+            acc = _mm512_xor_si512(acc, _mm512_xor_si512(_mm512_load_si512(t[2] + i), _mm512_load_si512(t[3] + i)));
+            acc = _mm512_xor_si512(acc, _mm512_xor_si512(_mm512_load_si512(t[4] + i), _mm512_load_si512(t[5] + i)));
+            acc = _mm512_xor_si512(acc, _mm512_xor_si512(_mm512_load_si512(t[6] + i), _mm512_load_si512(t[7] + i)));
+            _mm512_store_si512(h + i, acc);
+
+            __mmask16 le = _mm512_cmple_epu32_mask(acc, _mm512_load_si512(delta + i));
+            m |= (uint64_t)le << (v * 16);
+        }
+#elif defined(__AVX2__)
+        for (int v = 0; v < 8; v++)
+        {
+            int i = w * 64 + v * 8;
+            __m256i acc = _mm256_xor_si256(_mm256_load_si256((__m256i *)(t[0] + i)), _mm256_load_si256((__m256i *)(t[1] + i)));
+            acc = _mm256_xor_si256(acc, _mm256_xor_si256(_mm256_load_si256((__m256i *)(t[2] + i)), _mm256_load_si256((__m256i *)(t[3] + i))));
+            acc = _mm256_xor_si256(acc, _mm256_xor_si256(_mm256_load_si256((__m256i *)(t[4] + i)), _mm256_load_si256((__m256i *)(t[5] + i))));
+            acc = _mm256_xor_si256(acc, _mm256_xor_si256(_mm256_load_si256((__m256i *)(t[6] + i)), _mm256_load_si256((__m256i *)(t[7] + i))));
+            _mm256_store_si256((__m256i *)(h + i), acc);
+
+            // AVX2 has no unsigned comparison: h <= delta iff max(h, delta) == delta
+            __m256i d = _mm256_load_si256((__m256i *)(delta + i));
+            __m256i le = _mm256_cmpeq_epi32(_mm256_max_epu32(acc, d), d);
+            m |= (uint64_t)(uint8_t)_mm256_movemask_ps(_mm256_castsi256_ps(le)) << (v * 8);
+        }
+#else
+        for (int v = 0; v < 64; v++)
+        {
+            int i = w * 64 + v;
+            uint32_t acc = t[0][i] ^ t[1][i] ^ t[2][i] ^ t[3][i] ^ t[4][i] ^ t[5][i] ^ t[6][i] ^ t[7][i];
+            h[i] = acc;
+            m |= (uint64_t)(acc <= delta[i]) << v;
+        }
+#endif
+        return m;
+    }
+
+    /**
+     * Computes h_i(x) for every i in [64w, 64w + 64), storing it in h[i].
+     * Returns the bitmask whose j-th bit is set iff h_{64w+j}(x) <= delta[64w+j] (see hashAll).
+     * The padding rows are not masked out.
+     */
+    uint64_t hashWord(uint32_t x, int w, const uint32_t *delta, uint32_t *h)
+    {
+        const uint32_t *t[8];
+        this->select(x, t);
+        return this->hashWord(t, w, delta, h);
+    }
+
+    /**
+     * Computes h_i(x) for every i in [0, n), with n <= k, storing it in h[i].
+     * In the same pass compares h_i(x) with delta[i]: the i-th bit of mask is set iff h_i(x) <= delta[i],
+     * i.e. iff the i-th buffer of the sketch has to be updated.
+     * h and delta must have padded(n) entries (64-byte aligned), mask must have padded(n) / 64 words.
+     */
+    void hashAll(uint32_t x, int n, const uint32_t *delta, uint32_t *h, uint64_t *mask)
+    {
+        const uint32_t *t[8];
+        this->select(x, t);
+
+        for (int w = 0; w < padded(n) / 64; w++)
+            mask[w] = this->hashWord(t, w, delta, h);
+
+        // the padding rows must never be selected
+        if (n % 64 != 0)
+            mask[padded(n) / 64 - 1] &= (1ull << (n % 64)) - 1;
+    }
+};
+
+#endif
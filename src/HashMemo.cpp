@@ -0,0 +1,234 @@
+#ifndef HASHMEMO_H
+#define HASHMEMO_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdlib.h>
+#include <vector>
+#include "Sketch.cpp"
+
+using namespace std;
+
+/**
+ * Memo of the small hash values of the elements of a set, used to rebuild the buffers of a sketch without rehashing the set.
+ * For every element x it stores the pairs (i, h_i(x)) such that h_i(x) <= threshold, i.e. about k * threshold / 2^32 pairs.
+ * Since a buffer only needs the values <= delta, a row can be rebuilt from the pairs of the memo alone as long as it has
+ * at least one of them: its values <= threshold are exactly the pairs of the row (see the recovery of the sketches).
+ *
+ * The pairs are stored in a single packed array, so that a recovery is a sequential scan of n * k * threshold / 2^32 entries
+ * instead of n * k hash evaluations. The pairs of an element are contiguous: they are found through an open addressing
+ * table (linear probing, load factor at most 1/2) that maps the element to their position.
+ * A removal marks the pairs as dead, and the array is compacted when the dead pairs are more than the live ones.
+ */
+class HashMemo
+{
+private:
+    /**
+     * Entry: the hash value h of the row row (row is DEAD if the element has been removed)
+     */
+    struct Entry
+    {
+        uint32_t row;
+        num h;
+    };
+
+    static const uint32_t DEAD = UINT32_MAX;
+
+    /**
+     * Slot of the table: the pairs of x are entries[offset], ..., entries[offset + count - 1].
+     * The elements without pairs are not stored, so the empty slots are the ones with count 0.
+     */
+    struct Slot
+    {
+        num x;
+        uint32_t offset;
+        uint32_t count;
+    };
+
+    num threshold;
+
+    vector<Entry> entries;
+
+    Slot *slots;
+
+    /**
+     * capacity: the number of slots (a power of 2), mask = capacity - 1
+     */
+    size_t capacity;
+    size_t mask;
+
+    /**
+     * n: the number of elements in the table, dead: the number of dead entries
+     */
+    size_t n = 0;
+    size_t dead = 0;
+
+    size_t slot(num x)
+    {
+        return (size_t)(((uint64_t)x * 0x9e3779b97f4a7c15ull) >> 32) & this->mask;
+    }
+
+    /**
+     * Returns the slot of x, or the empty slot where x would be inserted
+     */
+    size_t find(num x)
+    {
+        size_t i = this->slot(x);
+        while (this->slots[i].count != 0 && this->slots[i].x != x)
+            i = (i + 1) & this->mask;
+        return i;
+    }
+
+    void grow()
+    {
+        Slot *old = this->slots;
+        size_t oldCapacity = this->capacity;
+
+        this->capacity *= 2;
+        this->mask = this->capacity - 1;
+        this->slots = (Slot *)calloc(this->capacity, sizeof(Slot));
+
+        for (size_t i = 0; i < oldCapacity; i++)
+            if (old[i].count != 0)
+                this->slots[this->find(old[i].x)] = old[i];
+
+        free(old);
+    }
+
+    /**
+     * Drops the dead entries, moving the pairs of every element (in the order of the table) to the front of the array
+     */
+    void compact()
+    {
+        vector<Entry> live;
+        live.reserve(this->entries.size() - this->dead);
+        for (size_t i = 0; i < this->capacity; i++)
+        {
+            Slot &s = this->slots[i];
+            if (s.count == 0)
+                continue;
+
+            uint32_t offset = live.size();
+            live.insert(live.end(), this->entries.begin() + s.offset, this->entries.begin() + s.offset + s.count);
+            s.offset = offset;
+        }
+
+        this->entries.swap(live);
+        this->dead = 0;
+    }
+
+public:
+    /**
+     * Constructor
+     * the memo keeps the hash values <= threshold.
+     */
+    HashMemo(num threshold) : threshold(threshold)
+    {
+        this->capacity = 16;
+        this->mask = this->capacity - 1;
+        this->slots = (Slot *)calloc(this->capacity, sizeof(Slot));
+    }
+
+    ~HashMemo()
+    {
+        free(this->slots);
+    }
+
+    /**
+     * Returns the largest hash value kept by the memo
+     */
+    num getThreshold()
+    {
+        return this->threshold;
+    }
+
+    /**
+     * Adds the pairs of x, given its k hash values h[0], ..., h[k-1] (nothing is done if x is already in the memo)
+     */
+    void insert(num x, const num *h, int k)
+    {
+        size_t i = this->find(x);
+        if (this->slots[i].count != 0)
+            return;
+
+        uint32_t offset = this->entries.size();
+        for (int r = 0; r < k; r++)
+            if (h[r] <= this->threshold)
+                this->entries.push_back(Entry{(uint32_t)r, h[r]});
+
+        uint32_t count = this->entries.size() - offset;
+        if (count == 0)
+            return;
+
+        this->slots[i] = Slot{x, offset, count};
+        this->n++;
+        if (2 * this->n > this->capacity)
+            this->grow();
+    }
+
+    /**
+     * Removes the pairs of x, if any
+     */
+    void erase(num x)
+    {
+        size_t i = this->find(x);
+        if (this->slots[i].count == 0)
+            return;
+
+        Slot &s = this->slots[i];
+        for (uint32_t j = 0; j < s.count; j++)
+            this->entries[s.offset + j].row = DEAD;
+        this->dead += s.count;
+
+        // backward shift, as in FlatHashStore
+        size_t j = i;
+        while (true)
+        {
+            j = (j + 1) & this->mask;
+            if (this->slots[j].count == 0)
+                break;
+
+            size_t home = this->slot(this->slots[j].x);
+            if (((j - home) & this->mask) >= ((j - i) & this->mask))
+            {
+                this->slots[i] = this->slots[j];
+                i = j;
+            }
+        }
+
+        this->slots[i].count = 0;
+        this->n--;
+
+        if (2 * this->dead > this->entries.size())
+            this->compact();
+    }
+
+    /**
+     * Calls f(i, h) on every pair of the memo, with a sequential scan of the packed array
+     */
+    template <class F>
+    void forEach(F f)
+    {
+        for (const Entry &e : this->entries)
+            if (e.row != DEAD)
+                f((int)e.row, e.h);
+    }
+
+    /**
+     * Returns the number of pairs in the memo
+     */
+    size_t size()
+    {
+        return this->entries.size() - this->dead;
+    }
+
+    /**
+     * Returns the number of bytes used by the memo
+     */
+    size_t bytes()
+    {
+        return this->capacity * sizeof(Slot) + this->entries.capacity() * sizeof(Entry);
+    }
+};
+
+#endif
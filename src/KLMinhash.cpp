@@ -0,0 +1,911 @@
+#ifndef KLMINHASH_H
+#define KLMINHASH_H
+
+#include <cstdint>
+#include <iostream>
+#include <stdlib.h>
+#include <unordered_set>
+#include <bits/stdc++.h>
+#include "hash.cpp"
+#include "HashBank.cpp"
+#include "Sketch.cpp"
+#include "RecoveryStore.cpp"
+#include "HashMemo.cpp"
+#include "Serialization.cpp"
+#include "Similarity.cpp"
+
+using namespace std;
+
+/**
+ * Common part of the l-buffered k-MinHash sketches (TreeKLMinhash and ArrayKLMinhash), which only differ in the layout of their buffers.
+ *
+ * The base holds the hash functions, delta, the explicit set and the whole logic that does not depend on the layout:
+ * the updates (one element, or a batch one block of 64 hash functions at a time), the recovery after a fault (of all the rows,
+ * of the faulty rows only, incremental), the hash memo and the serialization of the header of a record.
+ * It reaches the buffers of the sketch S (CRTP, no virtual call) through its primitives:
+ * - insertAt(i, h), removeAt(i, h): the update of the i-th buffer with the hash value h <= delta[i]
+ * - resetRow(i), isEmpty(i), getMin(i): the reset, the emptiness and the minimum of the i-th buffer
+ * - rowValues(i, values), setRow(i, values, n): the sorted values of the i-th buffer, and their replacement (see merge)
+ * - saveRow(writer, i), loadRow(view, i): the i-th row in the record of the sketch, whose kind is S::KIND (loadRow validates it)
+ * - printRow(i)
+ * and its allocate, that places delta, hashValues, rowMask, signature and the buffers in a single arena.
+ */
+template <class S, class H>
+class BasicKLMinhash : public Sketch
+{
+protected:
+    /**
+     * U: the maximum size of the set (aka the universe size)
+     */
+    num U;
+
+    /**
+     * k: number of hash functions and buffers in the signature
+     */
+    int k;
+
+    /**
+     * l: number of hash values for each buffer
+     */
+    int l;
+
+    /**
+     * arena: the single allocation of the sketch (see the allocate method of S)
+     */
+    num *arena = nullptr;
+
+    /**
+     * delta: the maximum value in each buffer
+     */
+    num *delta;
+
+    /**
+     * hashes: array of k hash functions
+     */
+    H **hashes;
+
+    bool doFreeHashes = true;
+
+    /**
+     * seed: the seed from which the hash functions are derived, if seeded is true (i.e. if the sketch is built with the seed constructor)
+     */
+    uint64_t seed = 0;
+    bool seeded = false;
+
+    /**
+     * bank: the k hash functions stored contiguously, if they are tabulation hash functions (nullptr otherwise).
+     * When it is not null, all the k hash values of an element are computed at once by bank->hashAll.
+     */
+    HashBank *bank = nullptr;
+
+    bool doFreeBank = false;
+
+    /**
+     * hashValues, rowMask: scratch space of bank->hashAll, i.e. the k hash values of the current element
+     * and the bitmask of the rows to be updated
+     */
+    num *hashValues;
+    uint64_t *rowMask;
+
+    /**
+     * signature: the minhash signature, copied from the minimums of the buffers by getSignature.
+     */
+    num *signature;
+
+    /**
+     * explicitSet: if true, the set is explicitly stored.
+     * TODO: it will be deleted in the future
+     */
+    bool explicitSet;
+
+    /**
+     * elements: the set, stored only to recover the sketch after a fault (see setRecoveryStore)
+     */
+    RecoveryStore *elements = nullptr;
+
+    bool doFreeElements = true;
+
+    /**
+     * rowRecovery: if true, a fault only resets (and rebuilds) the rows that get empty, otherwise all the rows are reset
+     */
+    bool rowRecovery = false;
+
+    /**
+     * faultyRows: the rows that got empty during the last update (only in row recovery mode)
+     */
+    vector<int> faultyRows;
+
+    /**
+     * recoveryStep: in incremental recovery mode, the number of elements reinserted at each update (0 if the recovery is synchronous)
+     */
+    int recoveryStep = 0;
+
+    /**
+     * State of the incremental recovery:
+     * - recovering: true if a recovery is in progress
+     * - recoveringAll, recoveringRows: the rows being rebuilt (all the rows, or only the given ones)
+     * - pending: the snapshot of the set taken at the fault, pending[recovered..] are still to be reinserted
+     * - touched: the elements updated during the recovery, that are not reinserted (their update has been applied directly)
+     */
+    bool recovering = false;
+    bool recoveringAll = false;
+    vector<int> recoveringRows;
+    vector<num> pending;
+    size_t recovered = 0;
+    std::unordered_set<num> touched;
+
+    /**
+     * memo: the small hash values of the elements of the set, used to recover the sketch without rehashing the set (see setHashMemo).
+     * nullptr if the memo is disabled.
+     */
+    HashMemo *memo = nullptr;
+
+    S *self()
+    {
+        return static_cast<S *>(this);
+    }
+
+    BasicKLMinhash() : U(1), k(1), l(1) {}
+
+    /**
+     * Constructor
+     * The sketch S allocates its arena and initializes its buffers.
+     */
+    BasicKLMinhash(int k, int l, num U, H **hashes, bool explicitSet, bool doFreeHashes)
+        : U(U), k(k), l(l), hashes(hashes), doFreeHashes(doFreeHashes), explicitSet(explicitSet)
+    {
+        // tabulation hash functions are evaluated all at once by a bank, shared by all the sketches built on the same hashes
+        this->bank = hashes != nullptr ? HashBank::fromHashes(hashes, k) : nullptr;
+        this->doFreeBank = true;
+
+        this->elements = explicitSet ? new FlatHashStore() : nullptr;
+        this->doFreeElements = true;
+    }
+
+    ~BasicKLMinhash()
+    {
+        free(this->arena);
+
+        if (this->doFreeBank)
+            HashBank::release(this->bank);
+        if (this->doFreeElements)
+            delete this->elements;
+        delete this->memo;
+
+        if (doFreeHashes)
+        {
+            for (int i = 0; i < k; i++)
+                delete this->hashes[i];
+
+            free(this->hashes);
+        }
+    }
+
+public:
+    /**
+     * Computes the hash of x using the i-th hash function
+     */
+    num hash(num x, int i)
+    {
+        if (this->bank != nullptr)
+            return this->bank->hash(i, x);
+        return (*this->hashes[i])(x);
+    }
+
+    void insert(num x)
+    {
+        this->insert(x, true);
+    }
+
+    /**
+     * Inserts x into the sketch.
+     * If insertIntoSet is true (default) and isExplicitSet flag is true, x is also explicitaly stored.
+     */
+    void insert(num x, bool insertIntoSet)
+    {
+        if (this->explicitSet && insertIntoSet)
+        {
+            this->elements->insert(x);
+            this->trackUpdate(x);
+        }
+
+        if (this->bank != nullptr)
+        {
+            // only the rows selected by the bank (h <= delta) are touched
+            this->bank->hashAll(x, this->k, this->delta, this->hashValues, this->rowMask);
+            for (int w = 0; w < HashBank::padded(this->k) / 64; w++)
+                for (uint64_t m = this->rowMask[w]; m != 0; m &= m - 1)
+                {
+                    int i = w * 64 + __builtin_ctzll(m);
+                    this->self()->insertAt(i, this->hashValues[i]);
+                }
+        }
+        else
+            for (int i = 0; i < this->k; i++)
+            {
+                num h = hash(x, i);
+                // num h = x;
+                this->hashValues[i] = h;
+                if (h > this->delta[i])
+                    continue;
+
+                this->self()->insertAt(i, h);
+            }
+
+        // hashValues holds all the k hash values of x
+        if (this->memo != nullptr && insertIntoSet)
+            this->memo->insert(x, this->hashValues, this->k);
+    }
+
+    /**
+     * Removes x from the sketch.
+     * If a fault occurs:
+     * - the method returns true
+     * - the buffer is reset (in row recovery mode, only the rows that get empty, see getFaultyRows)
+     * - if the explicitSet flag is true, all the elements are reinserted (only into the reset rows)
+     * The method returns false otherwise
+     */
+    bool remove(num x)
+    {
+        if (this->explicitSet)
+        {
+            this->elements->erase(x);
+            this->trackUpdate(x);
+        }
+        if (this->memo != nullptr)
+            this->memo->erase(x);
+        this->faultyRows.clear();
+
+        if (this->bank != nullptr)
+        {
+            this->bank->hashAll(x, this->k, this->delta, this->hashValues, this->rowMask);
+            for (int w = 0; w < HashBank::padded(this->k) / 64; w++)
+                for (uint64_t m = this->rowMask[w]; m != 0; m &= m - 1)
+                {
+                    int i = w * 64 + __builtin_ctzll(m);
+                    if (this->self()->removeAt(i, this->hashValues[i]))
+                    {
+                        if (!this->rowRecovery)
+                            return this->recover();
+                        this->faultyRows.push_back(i);
+                    }
+                }
+            return !this->faultyRows.empty() && this->recoverRows();
+        }
+
+        for (int i = 0; i < this->k; i++)
+        {
+            num h = hash(x, i);
+            // num h = x;
+            if (h > this->delta[i])
+                continue;
+
+            if (this->self()->removeAt(i, h))
+            {
+                if (!this->rowRecovery)
+                    return this->recover();
+                this->faultyRows.push_back(i);
+            }
+        }
+
+        return !this->faultyRows.empty() && this->recoverRows();
+    }
+
+    /**
+     * Applies a batch of n updates: xs[e] is inserted if ops[e] > 0, and removed otherwise.
+     * The batch is processed one block of 64 hash functions at a time (one at a time if the hash functions are not in a bank):
+     * every block is applied to the whole batch, so that its buffers stay in cache.
+     * The updates of the same buffer are applied in the order of the batch.
+     * If a buffer gets empty the remaining updates are skipped, and the sketch is recovered only once, at the end of the batch:
+     * - the method returns true
+     * - the buffer is reset (in row recovery mode, only the rows that get empty: the updates of the other rows are all applied)
+     * - if the explicitSet flag is true, all the elements (after the whole batch) are reinserted,
+     *   otherwise the caller has to reinsert them
+     * The method returns false otherwise
+     */
+    bool applyBatch(const num *xs, const int8_t *ops, size_t n)
+    {
+        if (this->explicitSet)
+            for (size_t e = 0; e < n; e++)
+            {
+                if (ops[e] > 0)
+                    this->elements->insert(xs[e]);
+                else
+                    this->elements->erase(xs[e]);
+            }
+        if (this->memo != nullptr)
+            for (size_t e = 0; e < n; e++)
+            {
+                // the block loop below only computes the hash values of one word at a time
+                if (ops[e] > 0)
+                    this->memoize(xs[e]);
+                else
+                    this->memo->erase(xs[e]);
+            }
+        if (this->recovering)
+        {
+            this->continueRecovery(this->recoveryStep * n);
+            for (size_t e = 0; e < n && this->recovering; e++)
+                this->touched.insert(xs[e]);
+        }
+        this->faultyRows.clear();
+
+        if (this->bank != nullptr)
+        {
+            const uint32_t *t[8];
+            for (int w = 0; w < HashBank::padded(this->k) / 64; w++)
+            {
+                // the padding rows must never be selected
+                uint64_t valid = (w + 1) * 64 <= this->k ? ~0ull : (1ull << (this->k % 64)) - 1;
+
+                for (size_t e = 0; e < n; e++)
+                {
+                    this->bank->select(xs[e], t);
+                    uint64_t m = this->bank->hashWord(t, w, this->delta, this->hashValues) & valid;
+                    for (; m != 0; m &= m - 1)
+                    {
+                        int i = w * 64 + __builtin_ctzll(m);
+                        if (ops[e] > 0)
+                            this->self()->insertAt(i, this->hashValues[i]);
+                        else if (this->self()->removeAt(i, this->hashValues[i]))
+                        {
+                            if (!this->rowRecovery)
+                                return this->recover();
+
+                            // the row is rebuilt at the end of the batch, its next updates are skipped
+                            this->faultyRows.push_back(i);
+                            valid &= ~(1ull << (i % 64));
+                        }
+                    }
+                }
+            }
+            return !this->faultyRows.empty() && this->recoverRows();
+        }
+
+        for (int i = 0; i < this->k; i++)
+            for (size_t e = 0; e < n; e++)
+            {
+                num h = hash(xs[e], i);
+                if (h > this->delta[i])
+                    continue;
+
+                if (ops[e] > 0)
+                    this->self()->insertAt(i, h);
+                else if (this->self()->removeAt(i, h))
+                {
+                    if (!this->rowRecovery)
+                        return this->recover();
+
+                    this->faultyRows.push_back(i);
+                    break;
+                }
+            }
+
+        return !this->faultyRows.empty() && this->recoverRows();
+    }
+
+    /**
+     * Recovers the sketch after a fault: the buffer is reset and, if the explicitSet flag is true, all the elements are reinserted.
+     * Returns true, i.e. the result of the update that caused the fault.
+     */
+    bool recover()
+    {
+        if (this->explicitSet && this->recoveryStep > 0 && this->memo == nullptr)
+        {
+            this->startRecovery(nullptr);
+            return true;
+        }
+
+        this->resetBuffer();
+        if (this->explicitSet)
+            this->fault();
+
+        return true;
+    }
+
+    /**
+     * Reinserts all the elements in the sketch (with the hash memo, if enabled, the buffers are rebuilt from the memo).
+     */
+    void fault()
+    {
+        if (this->memo != nullptr)
+        {
+            this->rebuildFromMemo(nullptr);
+            return;
+        }
+
+        this->elements->forEach([&](num x)
+                                { this->insert(x, false); });
+    }
+
+    /**
+     * Recovers the faulty rows (row recovery mode): they are reset and, if the explicitSet flag is true,
+     * all the elements are reinserted only into them, i.e. hashed only with their hash functions.
+     * Returns true, i.e. the result of the update that caused the fault.
+     */
+    bool recoverRows()
+    {
+        if (this->explicitSet && this->recoveryStep > 0 && this->memo == nullptr)
+        {
+            this->startRecovery(&this->faultyRows);
+            return true;
+        }
+
+        for (int i : this->faultyRows)
+            this->self()->resetRow(i);
+
+        if (this->explicitSet && this->memo != nullptr)
+            this->rebuildFromMemo(&this->faultyRows);
+        else if (this->explicitSet)
+        {
+            this->elements->forEach([&](num x)
+                                    { this->insertRows(x, this->faultyRows); });
+        }
+
+        return true;
+    }
+
+    /**
+     * Starts an incremental recovery of the given rows (of all the rows if rows is nullptr):
+     * the rows are reset, and the elements are reinserted a few at a time by the next updates (see continueRecovery).
+     * If a recovery is already in progress it is restarted, also on the rows it was rebuilding.
+     */
+    void startRecovery(const vector<int> *rows)
+    {
+        if (rows == nullptr || (this->recovering && this->recoveringAll))
+            this->recoveringAll = true;
+        else
+        {
+            if (!this->recovering)
+                this->recoveringRows.clear();
+            this->recoveringRows.insert(this->recoveringRows.end(), rows->begin(), rows->end());
+            sort(this->recoveringRows.begin(), this->recoveringRows.end());
+            this->recoveringRows.erase(unique(this->recoveringRows.begin(), this->recoveringRows.end()), this->recoveringRows.end());
+        }
+
+        if (this->recoveringAll)
+            this->resetBuffer();
+        else
+            for (int i : this->recoveringRows)
+                this->self()->resetRow(i);
+
+        this->pending.clear();
+        this->elements->forEach([&](num x)
+                                { this->pending.push_back(x); });
+        this->recovered = 0;
+        this->touched.clear();
+        this->recovering = true;
+    }
+
+    /**
+     * Reinserts (at most) the next budget elements of the incremental recovery, skipping the ones updated in the meantime.
+     * When all the elements have been reinserted the recovery is complete.
+     */
+    void continueRecovery(size_t budget)
+    {
+        for (; budget > 0 && this->recovered < this->pending.size(); budget--)
+        {
+            num x = this->pending[this->recovered++];
+            if (this->touched.count(x))
+                continue;
+
+            if (this->recoveringAll)
+                this->insert(x, false);
+            else
+                this->insertRows(x, this->recoveringRows);
+        }
+
+        if (this->recovered == this->pending.size())
+        {
+            this->recovering = false;
+            this->recoveringAll = false;
+            this->recoveringRows.clear();
+            this->pending = vector<num>();
+            this->touched.clear();
+        }
+    }
+
+    /**
+     * Advances the incremental recovery (if any) before an update of x, and marks x as updated
+     */
+    void trackUpdate(num x)
+    {
+        if (!this->recovering)
+            return;
+
+        this->continueRecovery(this->recoveryStep);
+        if (this->recovering)
+            this->touched.insert(x);
+    }
+
+    /**
+     * Enables the incremental recovery mode (only with an explicit set) if step > 0, or disables it if step is 0.
+     * After a fault the elements are not reinserted all at once: each of the next updates reinserts step elements,
+     * (step * n for a batch of n updates). Until the recovery is complete isRecovering returns true,
+     * and the signature of the rows being rebuilt can be larger than the exact one.
+     */
+    void setIncrementalRecovery(int step)
+    {
+        if (step == 0)
+            this->finishRecovery();
+        this->recoveryStep = step;
+    }
+
+    /**
+     * Completes the incremental recovery in progress (if any)
+     */
+    void finishRecovery()
+    {
+        if (this->recovering)
+            this->continueRecovery(this->pending.size());
+    }
+
+    /**
+     * Returns true if an incremental recovery is in progress, i.e. if the signature is not exact yet
+     */
+    bool isRecovering()
+    {
+        return this->recovering;
+    }
+
+    /**
+     * Inserts x only into the given rows.
+     * In row recovery mode, if the explicitSet flag is false, the caller recovers from a fault
+     * by calling insertRows(x, getFaultyRows()) for every element x of the set.
+     */
+    void insertRows(num x, const vector<int> &rows)
+    {
+        for (int i : rows)
+        {
+            num h = hash(x, i);
+            if (h <= this->delta[i])
+                this->self()->insertAt(i, h);
+        }
+    }
+
+    /**
+     * Enables (or disables) the row recovery mode: when a row gets empty, only that row is reset and rebuilt,
+     * instead of the whole sketch. The rows are independent, so the signature is the same in both modes.
+     */
+    void setRowRecovery(bool rowRecovery)
+    {
+        this->rowRecovery = rowRecovery;
+    }
+
+    /**
+     * Returns the rows that got empty (and have been reset) during the last update, in row recovery mode
+     */
+    const vector<int> &getFaultyRows()
+    {
+        return this->faultyRows;
+    }
+
+    /**
+     * Replaces the store of the set (by default a FlatHashStore, see RecoveryStore.cpp), copying the current elements into it.
+     * The sketch becomes explicit: e.g. with a CallbackStore the caller re-streams the set at every fault.
+     * If doFree is true the store is deleted with the sketch.
+     */
+    void setRecoveryStore(RecoveryStore *store, bool doFree = false)
+    {
+        if (this->elements != nullptr)
+        {
+            this->elements->forEach([&](num x)
+                                    { store->insert(x); });
+            if (this->doFreeElements)
+                delete this->elements;
+        }
+
+        this->elements = store;
+        this->doFreeElements = doFree;
+        this->explicitSet = true;
+    }
+
+    /**
+     * Enables the hash memo (only with an explicit set) if fraction > 0, or disables it if fraction is 0.
+     * The memo keeps, for every element, the hash values in the lowest fraction of the range [0, NUM_MAX] (see HashMemo),
+     * i.e. about 8 * k * fraction bytes per element, and a fault rebuilds the buffers from them without rehashing the set.
+     * A row rebuilt from the memo holds about n * fraction values (n is the size of the set): with fraction < l / n
+     * it is not full, and it gets empty (i.e. faults) sooner. A row without values in the memo is rebuilt by rehashing the set.
+     */
+    void setHashMemo(double fraction)
+    {
+        this->finishRecovery();
+        delete this->memo;
+        this->memo = nullptr;
+        if (fraction <= 0 || !this->explicitSet)
+            return;
+
+        this->memo = new HashMemo((num)min((double)NUM_MAX, fraction * NUM_MAX));
+        this->elements->forEach([&](num x)
+                                { this->memoize(x); });
+    }
+
+    /**
+     * Returns the hash memo (nullptr if it is disabled)
+     */
+    HashMemo *getHashMemo()
+    {
+        return this->memo;
+    }
+
+    /**
+     * Computes the k hash values of x and adds them to the memo
+     */
+    void memoize(num x)
+    {
+        if (this->bank != nullptr)
+            this->bank->hashAll(x, this->k, this->delta, this->hashValues, this->rowMask);
+        else
+            for (int i = 0; i < this->k; i++)
+                this->hashValues[i] = hash(x, i);
+
+        this->memo->insert(x, this->hashValues, this->k);
+    }
+
+    /**
+     * Rebuilds the given rows (all the rows if rows is nullptr), that have just been reset, from the hash memo.
+     * The memo holds all the values <= threshold of a row, so the buffer is exact with delta <= threshold:
+     * only the rows without values in the memo are rebuilt by rehashing the set.
+     */
+    void rebuildFromMemo(const vector<int> *rows)
+    {
+        vector<char> rebuilt(this->k, rows == nullptr);
+        if (rows != nullptr)
+            for (int i : *rows)
+                rebuilt[i] = 1;
+
+        this->memo->forEach([&](int i, num h)
+                            {
+                                if (rebuilt[i] && h <= this->delta[i])
+                                    this->self()->insertAt(i, h); });
+
+        num threshold = this->memo->getThreshold();
+        vector<int> missing;
+        for (int i = 0; i < this->k; i++)
+        {
+            if (!rebuilt[i])
+                continue;
+
+            if (this->self()->isEmpty(i))
+                missing.push_back(i);
+            else if (this->delta[i] > threshold)
+                this->delta[i] = threshold;
+        }
+
+        if (missing.empty())
+            return;
+
+        if (this->bank != nullptr && 16 * missing.size() > (size_t)this->k)
+        {
+            // hashing all the rows with the bank is cheaper than hashing the missing rows one at a time
+            vector<uint64_t> selected(HashBank::padded(this->k) / 64, 0);
+            for (int i : missing)
+                selected[i / 64] |= 1ull << (i % 64);
+
+            this->elements->forEach([&](num x)
+                                    {
+                                        this->bank->hashAll(x, this->k, this->delta, this->hashValues, this->rowMask);
+                                        for (int w = 0; w < HashBank::padded(this->k) / 64; w++)
+                                            for (uint64_t m = this->rowMask[w] & selected[w]; m != 0; m &= m - 1)
+                                            {
+                                                int i = w * 64 + __builtin_ctzll(m);
+                                                this->self()->insertAt(i, this->hashValues[i]);
+                                            } });
+        }
+        else
+            this->elements->forEach([&](num x)
+                                    { this->insertRows(x, missing); });
+    }
+
+    /**
+     * Returns the k-minhash signature
+     */
+    num *getSignature()
+    {
+        for (int i = 0; i < this->k; i++)
+            this->signature[i] = this->self()->getMin(i);
+        return this->signature;
+    }
+
+    /**
+     * Static method that given two sketches A & B returns the estimation of their jaccard similarity.
+     */
+    static double similarity(S *A, S *B)
+    {
+        num *sigA = A->getSignature();
+        num *sigB = B->getSignature();
+
+        return compare::jaccard(sigA, sigB, A->k);
+    }
+
+    /**
+     * Merges the sketch B into this sketch, so that it summarizes the union of the two sets.
+     * The sketches must have the same k, l and hash functions (e.g. built with the same seed): the method returns false otherwise.
+     * A buffer holds all the values of its set up to its delta, so the union of two rows is exact up to the minimum of their deltas:
+     * the sorted values of the two buffers are merged up to l values below it, and delta is recomputed.
+     * A value in both buffers is kept once, while the values repeated in the same buffer (colliding elements) are all kept.
+     * When there are no deletions the result is the same sketch built by inserting both sets.
+     * If both sketches have an explicit set, the elements of B are added to the set of this sketch.
+     * If only this sketch has an explicit set, the method returns false (and nothing is merged): its set could not hold
+     * the elements of B, and a recovery would rebuild the rows without them.
+     */
+    bool merge(S *B)
+    {
+        if (B->k != this->k || B->l != this->l || !this->sameHashes(B) || (this->explicitSet && !B->explicitSet))
+            return false;
+
+        this->finishRecovery();
+        B->finishRecovery();
+
+        vector<num> a(this->l), b(this->l), merged(this->l);
+        for (int i = 0; i < this->k; i++)
+        {
+            int na = this->self()->rowValues(i, a.data());
+            int nb = B->rowValues(i, b.data());
+            num limit = min(this->delta[i], B->delta[i]);
+
+            int p = 0, q = 0, n = 0;
+            while (n < this->l)
+            {
+                num va = p < na ? a[p] : NUM_MAX;
+                num vb = q < nb ? b[q] : NUM_MAX;
+                num h = min(va, vb);
+                if (h == NUM_MAX || h > limit)
+                    break;
+
+                p += va == h;
+                q += vb == h;
+                merged[n++] = h;
+            }
+
+            this->self()->setRow(i, merged.data(), n);
+            this->delta[i] = n == this->l ? merged[this->l - 1] : limit;
+        }
+        if (this->explicitSet && B->explicitSet)
+            B->elements->forEach([&](num x)
+                                 {
+                                     this->elements->insert(x);
+                                     if (this->memo != nullptr)
+                                         this->memoize(x); });
+
+        return true;
+    }
+
+    /**
+     * Returns true if B has the same hash functions of this sketch, i.e. if:
+     * - they share the bank or the array of the hash functions, or
+     * - both are built with the seed constructor, with the same seed, or
+     * - both have a bank, derived from the same seed (and first function) or with the same tables.
+     * Otherwise the functions cannot be compared, and the method returns false.
+     */
+    bool sameHashes(S *B)
+    {
+        if ((this->bank != nullptr && this->bank == B->bank) || (this->hashes != nullptr && this->hashes == B->hashes))
+            return true;
+        if (this->seeded && B->seeded)
+            return this->seed == B->seed;
+        if (this->bank == nullptr || B->bank == nullptr)
+            return false;
+
+        if (this->bank->isSeeded() && B->bank->isSeeded())
+            return this->bank->getSeed() == B->bank->getSeed() && this->bank->getFirst() == B->bank->getFirst();
+        return this->bank->sameFunctions(B->bank, this->k);
+    }
+
+    /**
+     * Returns the family of a record of the sketch built with the seed constructor, i.e. of its functions of the family H
+     * (0 if H cannot be saved). The type-erased sketch is built on a bank, saved as TABULATION.
+     */
+    static uint32_t seededFamily()
+    {
+        if constexpr (std::is_same<H, TabulationHash<num>>::value)
+            return serialization::SEEDED_TABULATION;
+        else if constexpr (std::is_same<H, PairWiseHash<num>>::value)
+            return serialization::SEEDED_PAIRWISE;
+        else
+            return 0;
+    }
+
+    /**
+     * Saves the sketch to the stream (opened in binary mode), in the format described in Serialization.cpp.
+     * The hash functions are saved as their seed: the method returns false if they are not derived from a seed
+     * (i.e. if they are given to the constructor), if their family H has no record family (see seededFamily), or if the stream fails.
+     * The explicit set and the hash memo are not saved. An incremental recovery in progress is completed first.
+     */
+    bool save(ostream &out)
+    {
+        uint32_t family;
+        uint64_t seed;
+        int first = 0;
+        if (this->bank != nullptr && this->bank->isSeeded())
+        {
+            family = serialization::TABULATION;
+            seed = this->bank->getSeed();
+            first = this->bank->getFirst();
+        }
+        else if (this->seeded && seededFamily() != 0)
+        {
+            family = seededFamily();
+            seed = this->seed;
+        }
+        else
+            return false;
+
+        this->finishRecovery();
+
+        SketchRecordWriter writer(out, S::KIND, family, this->k, this->l, this->U, first, seed);
+        writer.write(this->delta, this->k);
+        writer.write(this->getSignature(), this->k);
+        for (int i = 0; i < this->k; i++)
+            this->self()->saveRow(writer, i);
+        return writer.close();
+    }
+
+    /**
+     * Loads the next sketch saved in the stream. Returns nullptr if the stream does not contain a sketch of kind S::KIND.
+     */
+    static S *load(istream &in)
+    {
+        vector<uint64_t> data;
+        SketchView view = readRecord(in, data);
+        return view.valid() ? load(view) : nullptr;
+    }
+
+    /**
+     * Builds a sketch from a saved record (e.g. the view of a MappedSketchFile), copying its buffers: no element is rehashed.
+     * The hash functions are derived again from the seed. The sketch is implicit (see save).
+     * Returns nullptr if the record is not a sketch of kind S::KIND, if its functions are not of the family H
+     * (a seeded record saved with another H, see seededFamily), or if it is malformed:
+     * k and l out of range (see SketchView::valid), or a row inconsistent with its delta (see loadRow).
+     */
+    static S *load(SketchView view)
+    {
+        if (!view.valid() || view.kind() != S::KIND || view.first() < 0 || view.first() > INT_MAX - view.k())
+            return nullptr;
+
+        int k = view.k();
+        int l = view.l();
+        S *sketch;
+        if (view.family() == serialization::TABULATION)
+        {
+            sketch = new S(k, l, view.U(), new HashBank(k, view.seed(), view.first()), false);
+            sketch->doFreeBank = true;
+        }
+        else if (view.family() == seededFamily() && seededFamily() != 0 && view.first() == 0)
+            sketch = new S(k, l, view.U(), false, view.seed());
+        else
+            return nullptr;
+
+        for (int i = 0; i < k; i++)
+        {
+            sketch->delta[i] = view.delta(i);
+            if (!sketch->loadRow(view, i))
+            {
+                delete sketch;
+                return nullptr;
+            }
+        }
+
+        return sketch;
+    }
+
+    /**
+     * Resets the buffer to default values.
+     */
+    void resetBuffer()
+    {
+        for (int i = 0; i < this->k; i++)
+            this->self()->resetRow(i);
+    }
+
+    /**
+     * Prints the signature matrix.
+     */
+    void print()
+    {
+        for (int i = 0; i < this->k; i++)
+            this->self()->printRow(i);
+    }
+};
+
+#endif
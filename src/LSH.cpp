@@ -6,23 +6,19 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <iostream>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "hash.cpp"
+#include "CandidatePairs.cpp"
 
 using namespace std;
 
-struct hash_pair
-{
-    size_t operator()(const pair<int, int> &p) const
-    {
-        auto hash1 = hash<int>{}(p.first);
-        auto hash2 = hash<int>{}(p.second);
-
-        if (hash1 != hash2)
-            return hash1 ^ hash2;
-
-        return hash1;
-    }
-};
-
 string toString(uint32_t *sequence, int size)
 {
     ostringstream oss("");
@@ -45,75 +41,435 @@ uint32_t XorIt(uint32_t *sequence, int size)
     return h;
 }
 
+/**
+ * Returns the 64-bit fingerprint of a band of r values: the values are absorbed two at a time (as a 64-bit word),
+ * each one followed by the SplitMix64 finalizer, so that two different bands collide with probability about 2^-64.
+ */
+inline uint64_t bandFingerprint(const uint32_t *band, int r)
+{
+    uint64_t h = r;
+    int i = 0;
+    for (; i + 2 <= r; i += 2)
+        h = SplitMix64::at(h ^ ((uint64_t)band[i + 1] << 32 | band[i]), i);
+    if (i < r)
+        h = SplitMix64::at(h ^ band[i], i);
+    return h;
+}
+
+/**
+ * Table of the buckets of a band: a flat open-addressing table (linear probing) with a slot for every distinct band,
+ * keyed by its fingerprint. Two bands with the same fingerprint are also compared value by value, so that the buckets are exact
+ * even if the fingerprints collide. The elements of a bucket are linked by next, starting from the first element of the slot.
+ */
+class BandTable
+{
+private:
+    struct Slot
+    {
+        uint64_t fingerprint;
+        int first;
+        int count;
+    };
+
+    vector<Slot> slots;
+    vector<int> next;
+    size_t mask;
+
+public:
+    /**
+     * Constructor of the table of n elements (at most n buckets, with load factor at most 1/2)
+     */
+    BandTable(int n)
+    {
+        size_t capacity = 16;
+        while (capacity < 2 * (size_t)n)
+            capacity *= 2;
+        this->slots.assign(capacity, {0, -1, 0});
+        this->next.assign(n, -1);
+        this->mask = capacity - 1;
+    }
+
+    /**
+     * Inserts the element id, whose band is signatures[id][offset, offset + r), into its bucket
+     */
+    void insert(int id, uint32_t **signatures, int offset, int r)
+    {
+        const uint32_t *band = signatures[id] + offset;
+        uint64_t fingerprint = bandFingerprint(band, r);
+
+        for (size_t p = fingerprint & this->mask;; p = (p + 1) & this->mask)
+        {
+            Slot &slot = this->slots[p];
+            if (slot.first == -1)
+            {
+                slot = {fingerprint, id, 1};
+                return;
+            }
+            if (slot.fingerprint == fingerprint && memcmp(signatures[slot.first] + offset, band, r * sizeof(uint32_t)) == 0)
+            {
+                this->next[id] = slot.first;
+                slot.first = id;
+                slot.count++;
+                return;
+            }
+        }
+    }
+
+    /**
+     * Calls f(first, count) for every bucket: first is its first element, and the following ones are given by getNext
+     */
+    template <class F>
+    void forEachBucket(F f)
+    {
+        for (Slot &slot : this->slots)
+            if (slot.first != -1)
+                f(slot.first, slot.count);
+    }
+
+    /**
+     * Returns the element after id in its bucket (-1 if it is the last one)
+     */
+    int getNext(int id)
+    {
+        return this->next[id];
+    }
+};
+
+/**
+ * How the heavy buckets, with more than maxBucket elements, are handled (see LSHOptions)
+ * - HEAVY_SAMPLE: only the pairs of maxBucket elements of the bucket, sampled at random, are candidates
+ * - HEAVY_SPLIT: the bucket is split by an extra sub-band, taken from the values of the signature after the b * r indexed ones
+ *   (see LSHOptions::k), so that only the elements that also agree on the sub-band are candidates. If the signatures have no such values,
+ *   the bucket is split at random in about count / maxBucket sub-buckets, by a hash of the elements seeded by the band.
+ *   The sub-buckets that are still heavy are sampled
+ */
+enum HeavyBucketPolicy
+{
+    HEAVY_SAMPLE,
+    HEAVY_SPLIT
+};
+
+/**
+ * Statistics of the buckets of every band, filled by computeLSH and computeLSHSorted
+ */
+struct LSHStats
+{
+    static const int BINS = 32;
+
+    /**
+     * histogram[j][i]: the number of buckets of the band j with size in [2^i, 2^(i+1))
+     */
+    vector<array<uint64_t, BINS>> histogram;
+
+    /**
+     * largest[j]: the size of the largest bucket of the band j
+     */
+    vector<int> largest;
+
+    /**
+     * heavy[j]: the number of heavy buckets of the band j
+     */
+    vector<uint64_t> heavy;
+
+    /**
+     * pairs[j]: the number of pairs emitted by the band j (before removing the duplicates), i.e. its cost
+     */
+    vector<uint64_t> pairs;
+
+    void reset(int b)
+    {
+        array<uint64_t, BINS> empty;
+        empty.fill(0);
+        this->histogram.assign(b, empty);
+        this->largest.assign(b, 0);
+        this->heavy.assign(b, 0);
+        this->pairs.assign(b, 0);
+    }
+
+    /**
+     * Prints a line for every band (for the first bands bands, if bands >= 0): band, largest bucket, heavy buckets, pairs,
+     * and the histogram (the number of buckets of size 1, 2-3, 4-7, ...)
+     */
+    void print(ostream &out, int bands = -1)
+    {
+        size_t n_bands = bands >= 0 ? min((size_t)bands, this->histogram.size()) : this->histogram.size();
+        out << "band,largest,heavy,pairs,histogram" << endl;
+        for (size_t j = 0; j < n_bands; j++)
+        {
+            int last = BINS - 1;
+            while (last > 0 && this->histogram[j][last] == 0)
+                last--;
+
+            out << j << "," << this->largest[j] << "," << this->heavy[j] << "," << this->pairs[j] << ",";
+            for (int i = 0; i <= last; i++)
+                out << this->histogram[j][i] << (i < last ? " " : "");
+            out << endl;
+        }
+    }
+};
+
+/**
+ * Options of computeLSH and computeLSHSorted
+ */
+struct LSHOptions
+{
+    /**
+     * maxBucket: the size above which a bucket is heavy (0: no bucket is heavy, all the pairs of every bucket are candidates)
+     */
+    int maxBucket = 0;
+
+    HeavyBucketPolicy policy = HEAVY_SAMPLE;
+
+    /**
+     * k: the number of values of every signature (0: b * r). The values after the first b * r ones are not indexed,
+     * and they are used to split the heavy buckets (see HEAVY_SPLIT)
+     */
+    int k = 0;
+
+    /**
+     * seed: the seed of the sampling, so that the candidates are the same in every run
+     */
+    uint64_t seed = 0;
+
+    /**
+     * stats: if not null, it is filled with the statistics of the buckets
+     */
+    LSHStats *stats = nullptr;
+};
+
+/**
+ * Adds all the pairs of the first min(count, maxBucket) elements of ids, after moving a random sample of maxBucket elements
+ * to the front if count > maxBucket (maxBucket = 0: all the elements). Returns the number of pairs.
+ */
+inline uint64_t addBucketPairs(int *ids, int count, int maxBucket, uint64_t seed, CandidatePairs *candidatePairs, int thread)
+{
+    int m = count;
+    if (maxBucket > 0 && count > maxBucket)
+    {
+        // partial Fisher-Yates shuffle, seeded by the bucket so that the sample does not depend on the order of its elements
+        sort(ids, ids + count);
+        SplitMix64 rng(SplitMix64::at(seed, ids[0]));
+        for (int x = 0; x < maxBucket; x++)
+            swap(ids[x], ids[x + rng.upTo(count - 1 - x)]);
+        m = maxBucket;
+    }
+
+    for (int x = 0; x < m; x++)
+        for (int y = x + 1; y < m; y++)
+            candidatePairs->add(thread, ids[x], ids[y]);
+    return (uint64_t)m * (m - 1) / 2;
+}
+
+/**
+ * Adds the candidate pairs of a bucket of the band j (the count elements of ids), handling it as set by the options if it is heavy,
+ * and updates the statistics. Every pair is visited once.
+ */
+inline void addBucket(int *ids, int count, int j, uint32_t **signatures, int r, int b, const LSHOptions &options, CandidatePairs *candidatePairs, int thread)
+{
+    LSHStats *stats = options.stats;
+    if (stats != nullptr)
+    {
+        stats->histogram[j][min(LSHStats::BINS - 1, 31 - __builtin_clz(count))]++;
+        stats->largest[j] = max(stats->largest[j], count);
+    }
+    if (count < 2)
+        return;
+
+    uint64_t seed = SplitMix64::at(options.seed, j);
+    uint64_t pairs = 0;
+    if (options.maxBucket == 0 || count <= options.maxBucket)
+        pairs = addBucketPairs(ids, count, 0, seed, candidatePairs, thread);
+    else if (options.policy == HEAVY_SAMPLE)
+        pairs = addBucketPairs(ids, count, options.maxBucket, seed, candidatePairs, thread);
+    else
+    {
+        // the elements are sorted by the key of their sub-bucket, and every run is a sub-bucket
+        // (a collision of the fingerprints only adds some candidates). The sub-band must not be part of an indexed band,
+        // otherwise every pair of a sub-bucket would already be a candidate of that band
+        int extra = options.k - b * r;
+        int width = min(r, extra);
+        int sub = extra > 0 ? b * r + (int)((uint64_t)j * width % (extra - width + 1)) : 0;
+        uint64_t groups = (count + options.maxBucket - 1) / options.maxBucket;
+
+        vector<pair<uint64_t, int>> keyed(count);
+        for (int x = 0; x < count; x++)
+            keyed[x] = {extra > 0 ? bandFingerprint(signatures[ids[x]] + sub, width) : SplitMix64::at(seed, ids[x]) % groups, ids[x]};
+        sort(keyed.begin(), keyed.end());
+        for (int x = 0; x < count; x++)
+            ids[x] = keyed[x].second;
+
+        for (int start = 0, end; start < count; start = end)
+        {
+            end = start + 1;
+            while (end < count && keyed[end].first == keyed[start].first)
+                end++;
+            pairs += addBucketPairs(ids + start, end - start, options.maxBucket, seed, candidatePairs, thread);
+        }
+    }
+
+    if (stats != nullptr)
+    {
+        stats->heavy[j] += options.maxBucket > 0 && count > options.maxBucket;
+        stats->pairs[j] += pairs;
+    }
+}
+
 /**
  * Compute the Locality Sensitive Hashing of the signatures
+ * The bands are keyed by their 64-bit fingerprint in a flat table for each band (see BandTable), one band at a time.
+ * The heavy buckets are handled as set by the options (see LSHOptions).
  * @param signatures the signatures of the elements
  * @param n the number of elements
  * @param r the number of elements in each band
  * @param b the number of bands
+ * @param options the handling of the heavy buckets and the statistics
  * @return the candidate pairs
  */
-unordered_set<pair<int, int>, hash_pair> *computeLSH(uint32_t **signatures, int n, int r, int b)
+CandidatePairs *computeLSH(uint32_t **signatures, int n, int r, int b, const LSHOptions &options = LSHOptions())
 {
-    unordered_multimap<string, int> *H = new unordered_multimap<string, int>[b];
-    // unordered_multimap<uint32_t, int> *H = new unordered_multimap<uint32_t, int>[b];
+    CandidatePairs *candidatePairs = new CandidatePairs(n);
+    if (options.stats != nullptr)
+        options.stats->reset(b);
 
+    vector<int> ids;
     for (int j = 0; j < b; j++)
-        H[j].reserve(10 * n);
+    {
+        BandTable H(n);
+        for (int i = 0; i < n; i++)
+            H.insert(i, signatures, j * r, r);
+
+        std::clog << "\rBand: " << j << "    " << std::flush;
 
-    unordered_set<string> *seenKeys = new unordered_set<string>[b];
-    // unordered_set<uint32_t> *seenKeys = new unordered_set<uint32_t>[b];
+        H.forEachBucket([&](int first, int count)
+                        {
+                            ids.clear();
+                            for (int el = first; el != -1; el = H.getNext(el))
+                                ids.push_back(el);
+                            addBucket(ids.data(), count, j, signatures, r, b, options, candidatePairs, 0); });
+    }
+    cerr << endl;
 
-    for (int i = 0; i < n; i++)
+    candidatePairs->finalize();
+    return candidatePairs;
+}
+
+/**
+ * Record of the sort-based LSH (see computeLSHSorted): the fingerprint of the band of an element
+ */
+struct BandRecord
+{
+    uint64_t key;
+    uint32_t id;
+    uint32_t band;
+};
+
+static_assert(sizeof(BandRecord) == 16, "a band record must take 16 bytes");
+
+/**
+ * Sorts the n records by key with a stable LSD radix sort (8 passes of 8 bits, the passes in which all the keys have the same digit
+ * are skipped), using tmp (n records) as scratch space. The sorted records are in records (nothing to do if n < 2).
+ */
+inline void radixSortBand(BandRecord *records, BandRecord *tmp, size_t n)
+{
+    if (n < 2)
+        return;
+
+    size_t count[256];
+    for (int shift = 0; shift < 64; shift += 8)
     {
-        for (int j = 0; j < b; j++)
+        memset(count, 0, sizeof(count));
+        for (size_t i = 0; i < n; i++)
+            count[(records[i].key >> shift) & 0xff]++;
+        if (count[records[0].key >> shift & 0xff] == n)
+            continue;
+
+        size_t sum = 0;
+        for (int d = 0; d < 256; d++)
         {
-            string s = toString(signatures[i] + j * r, r);
-            // uint32_t s = XorIt(signatures[i] + j * r, r);
-            H[j].insert({s, i});
-            seenKeys[j].insert(s);
+            size_t c = count[d];
+            count[d] = sum;
+            sum += c;
         }
+        for (size_t i = 0; i < n; i++)
+            tmp[count[(records[i].key >> shift) & 0xff]++] = records[i];
+        memcpy(records, tmp, n * sizeof(BandRecord));
     }
+}
 
-    unordered_set<pair<int, int>, hash_pair> *candidatePairs = new unordered_set<pair<int, int>, hash_pair>();
-    for (int j = 0; j < b; j++)
-    {
-        // cout << "Tabella hash: " << j << endl;
-        // for (auto itr = H[j].begin(); itr != H[j].end(); itr++)
-        // {
-        //     cout << "[" << H[j].bucket(itr->first) << "] " << itr->first << " -> " << itr->second << endl;
-        // }
-        // cout << endl;
+/**
+ * Compute the Locality Sensitive Hashing of the signatures, sorting the bands instead of hashing them (see computeLSH).
+ * The n * b records (fingerprint of the band, element) are built in a single array, O(n * b) records of 16 bytes,
+ * and the bands are processed in parallel (OpenMP): the n records of a band are radix sorted by fingerprint, and the candidate pairs
+ * are emitted from the runs of equal fingerprints (a run is split in buckets of equal bands, which is a single bucket
+ * unless the fingerprints collide). Every thread adds its pairs to its own buffer of the CandidatePairs.
+ * The heavy buckets are handled as set by the options (see LSHOptions).
+ * @param signatures the signatures of the elements
+ * @param n the number of elements
+ * @param r the number of elements in each band
+ * @param b the number of bands
+ * @param options the handling of the heavy buckets and the statistics
+ * @return the candidate pairs
+ */
+CandidatePairs *computeLSHSorted(uint32_t **signatures, int n, int r, int b, const LSHOptions &options = LSHOptions())
+{
+    if (options.stats != nullptr)
+        options.stats->reset(b);
+
+    BandRecord *records = (BandRecord *)malloc((size_t)n * b * sizeof(BandRecord));
+#ifdef _OPENMP
+    CandidatePairs *candidatePairs = new CandidatePairs(n, omp_get_max_threads());
+#else
+    CandidatePairs *candidatePairs = new CandidatePairs(n);
+#endif
 
-        std::clog << "\rBand: " << j << ", Candidates: " << candidatePairs->size() << "    " << std::flush;
+#pragma omp parallel
+    {
+#ifdef _OPENMP
+        int thread = omp_get_thread_num();
+#else
+        int thread = 0;
+#endif
+        vector<BandRecord> tmp(n);
+        vector<int> ids, rest;
 
-        for (auto key = seenKeys[j].begin(); key != seenKeys[j].end(); key++)
+#pragma omp for schedule(dynamic, 1)
+        for (int j = 0; j < b; j++)
         {
-            int bucket_index = H[j].bucket(*key);
-            if (H[j].bucket_size(bucket_index) > 1)
+            BandRecord *band = records + (size_t)j * n;
+            for (int i = 0; i < n; i++)
+                band[i] = {bandFingerprint(signatures[i] + j * r, r), (uint32_t)i, (uint32_t)j};
+
+            radixSortBand(band, tmp.data(), n);
+
+            for (int start = 0, end; start < n; start = end)
             {
-                auto bucket = H[j].equal_range(*key);
-                for (auto el1 = bucket.first; el1 != bucket.second; el1++)
+                end = start + 1;
+                while (end < n && band[end].key == band[start].key)
+                    end++;
+
+                ids.clear();
+                for (int x = start; x < end; x++)
+                    ids.push_back(band[x].id);
+
+                // on a collision of the fingerprints the run is split in the buckets of equal bands
+                while (!ids.empty())
                 {
-                    for (auto el2 = bucket.first; el2 != bucket.second; el2++)
-                    {
-                        int A = el1->second;
-                        int B = el2->second;
-
-                        if (A > B)
-                            candidatePairs->insert({B, A});
-                        else if (B > A)
-                            candidatePairs->insert({A, B});
-                    }
+                    const uint32_t *first = signatures[ids[0]] + j * r;
+                    auto split = stable_partition(ids.begin(), ids.end(), [&](int id)
+                                                  { return memcmp(signatures[id] + j * r, first, r * sizeof(uint32_t)) == 0; });
+                    rest.assign(split, ids.end());
+                    ids.erase(split, ids.end());
+
+                    addBucket(ids.data(), (int)ids.size(), j, signatures, r, b, options, candidatePairs, thread);
+                    ids.swap(rest);
                 }
             }
         }
     }
-    cerr << endl;
 
-    delete[] H;
-    delete[] seenKeys;
+    free(records);
 
+    candidatePairs->finalize();
     return candidatePairs;
 }
 
@@ -0,0 +1,322 @@
+#ifndef OPHKLMINHASH_H
+#define OPHKLMINHASH_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdlib.h>
+#include "hash.cpp"
+#include "Sketch.cpp"
+#include "RecoveryStore.cpp"
+#include "TreeKLMinhash.cpp"
+#include "Similarity.cpp"
+
+using namespace std;
+
+/**
+ * ℓ-buffered one permutation hashing (OPH) sketch.
+ * A single hash function h maps every element x to one of k bins, the bin (h(x) * k) >> 32, i.e. the range of h is split in k intervals.
+ * As in TreeKLMinhash, every bin keeps a sorted buffer of the l smallest values of h of its elements, and delta, the largest value
+ * that the buffer is guaranteed to hold: so an update costs a single hash evaluation, instead of the k of the KLMinhash sketches.
+ *
+ * A bin can be empty because none of the elements falls into it (it has never dropped a value, i.e. its delta is NUM_MAX)
+ * or because its values have been deleted: only in the second case the bin has lost some values, and a fault occurs.
+ * The empty bins of the signature are filled by optimal densification (A. Shrivastava, "Optimal densification for fast and
+ * accurate minwise hashing", ICML 2017): the i-th empty bin takes the value of the first non-empty bin of the sequence
+ * g(i, 0), g(i, 1), ..., where g is a hash function derived from the seed, so that it is the same in all the sketches with the same seed.
+ */
+class OPHKLMinhash : public Sketch
+{
+private:
+    /**
+     * k: number of bins in the signature
+     */
+    int k;
+
+    /**
+     * l: number of hash values for each bin
+     */
+    int l;
+
+    /**
+     * stride: l rounded up to a multiple of 16 (64 bytes), i.e. the distance between two consecutive buffers
+     */
+    int stride;
+
+    /**
+     * seed: the seed of h and of the densification
+     */
+    uint64_t seed;
+
+    /**
+     * hash: the hash function h
+     */
+    TabulationHash<num> *hash;
+
+    /**
+     * arena: the single allocation holding delta, signature and buffers
+     */
+    num *arena;
+
+    /**
+     * buffers: the i-th buffer starts at buffers[i * stride], it holds the smallest values of the bin in increasing order (padded with NUM_MAX)
+     */
+    num *buffers;
+
+    /**
+     * delta: the largest value of each bin that is held by its buffer
+     */
+    num *delta;
+
+    /**
+     * signature: the OPH signature, computed by getSignature
+     */
+    num *signature;
+
+    /**
+     * explicitSet: if true, the set is explicitly stored
+     */
+    bool explicitSet;
+
+    /**
+     * elements: the set, stored only to recover the sketch after a fault (see setRecoveryStore)
+     */
+    RecoveryStore *elements = nullptr;
+
+    bool doFreeElements = true;
+
+    /**
+     * faultyBin: the bin that got empty during the last remove (-1 if no fault occurred)
+     */
+    int faultyBin = -1;
+
+public:
+    OPHKLMinhash(int k, int l, num U, bool explicitSet = true)
+    {
+        new (this) OPHKLMinhash(k, l, U, explicitSet, randomSeed());
+    }
+
+    /**
+     * Constructor
+     * h and the densification are derived from the seed, so that two sketches built with the same seed can be compared.
+     * U (the universe size) is taken for the same signature as the other sketches: h ranges over all the 32-bit values.
+     */
+    OPHKLMinhash(int k, int l, num U, bool explicitSet, uint64_t seed) : k(k), l(l), seed(seed), explicitSet(explicitSet)
+    {
+        SplitMix64 rng(seed);
+        this->hash = new TabulationHash<num>(UINT32_MAX, rng);
+
+        int padded = (k + 15) & ~15;
+        this->stride = (l + 15) & ~15;
+        this->arena = (num *)aligned_alloc(64, (2 * (size_t)padded + (size_t)k * this->stride) * sizeof(num));
+        this->delta = this->arena;
+        this->signature = this->arena + padded;
+        this->buffers = this->arena + 2 * padded;
+
+        this->elements = explicitSet ? new FlatHashStore() : nullptr;
+        this->doFreeElements = true;
+
+        this->resetBuffer();
+    }
+
+    ~OPHKLMinhash()
+    {
+        free(this->arena);
+        delete this->hash;
+        if (this->doFreeElements)
+            delete this->elements;
+    }
+
+    /**
+     * Returns the bin of the hash value h
+     */
+    int bin(num h)
+    {
+        return (int)(((uint64_t)h * this->k) >> 32);
+    }
+
+    void insert(num x)
+    {
+        this->insert(x, true);
+    }
+
+    /**
+     * Inserts x into the sketch.
+     * If insertIntoSet is true (default) and isExplicitSet flag is true, x is also explicitaly stored.
+     */
+    void insert(num x, bool insertIntoSet)
+    {
+        if (this->explicitSet && insertIntoSet)
+            this->elements->insert(x);
+
+        num h = (*this->hash)(x);
+        int i = this->bin(h);
+        if (h <= this->delta[i])
+            this->insertAt(i, h);
+    }
+
+    /**
+     * Inserts the hash value h (with h <= delta[i]) into the i-th buffer.
+     */
+    void insertAt(int i, num h)
+    {
+        // the maximum (the last entry) is dropped, and the entries after h are shifted to the right
+        num *buffer = this->buffers + (size_t)i * this->stride;
+        int j = TreeKLMinhash::upperBound(buffer, this->l - 1, h);
+        memmove(buffer + j + 1, buffer + j, (this->l - 1 - j) * sizeof(num));
+        buffer[j] = h;
+
+        num max = buffer[this->l - 1];
+        if (max < this->delta[i])
+            this->delta[i] = max;
+    }
+
+    /**
+     * Removes x from the sketch.
+     * If a fault occurs, i.e. if a bin that has dropped some values gets empty:
+     * - the method returns true
+     * - if the explicitSet flag is true, only the faulty bin is reset and rebuilt, by reinserting the elements that fall into it
+     * - otherwise all the bins are reset, and the caller has to reinsert all the elements
+     * The method returns false otherwise
+     */
+    bool remove(num x)
+    {
+        if (this->explicitSet)
+            this->elements->erase(x);
+        this->faultyBin = -1;
+
+        num h = (*this->hash)(x);
+        int i = this->bin(h);
+        if (h > this->delta[i])
+            return false;
+
+        num *buffer = this->buffers + (size_t)i * this->stride;
+        int j = TreeKLMinhash::upperBound(buffer, this->l, h);
+        if (j == 0 || buffer[j - 1] != h)
+            return false;
+
+        memmove(buffer + j - 1, buffer + j, (this->l - j) * sizeof(num));
+        buffer[this->l - 1] = NUM_MAX;
+
+        // a bin that has never dropped a value holds all its elements: if it gets empty, it is just empty
+        if (buffer[0] != NUM_MAX || this->delta[i] == NUM_MAX)
+            return false;
+
+        this->faultyBin = i;
+        if (!this->explicitSet)
+        {
+            this->resetBuffer();
+            return true;
+        }
+
+        this->resetBin(i);
+        this->elements->forEach([&](num y)
+                                {
+                                    num g = (*this->hash)(y);
+                                    if (this->bin(g) == i && g <= this->delta[i])
+                                        this->insertAt(i, g); });
+        return true;
+    }
+
+    /**
+     * Returns the bin that got empty during the last remove (-1 if no fault occurred)
+     */
+    int getFaultyBin()
+    {
+        return this->faultyBin;
+    }
+
+    /**
+     * Replaces the store of the set (by default a FlatHashStore, see RecoveryStore.cpp), copying the current elements into it.
+     * If doFree is true the store is deleted with the sketch.
+     */
+    void setRecoveryStore(RecoveryStore *store, bool doFree = false)
+    {
+        if (this->elements != nullptr)
+        {
+            this->elements->forEach([&](num x)
+                                    { store->insert(x); });
+            if (this->doFreeElements)
+                delete this->elements;
+        }
+
+        this->elements = store;
+        this->doFreeElements = doFree;
+        this->explicitSet = true;
+    }
+
+    /**
+     * Returns the OPH signature: the minimum of every non-empty bin, and the densified value of the empty bins.
+     * If the set is empty, all the entries are NUM_MAX.
+     */
+    num *getSignature()
+    {
+        bool dense = true;
+        for (int i = 0; i < this->k; i++)
+        {
+            this->signature[i] = this->buffers[(size_t)i * this->stride];
+            dense &= this->signature[i] != NUM_MAX;
+        }
+        if (dense)
+            return this->signature;
+
+        bool empty = true;
+        for (int i = 0; i < this->k && empty; i++)
+            empty = this->signature[i] == NUM_MAX;
+        if (empty)
+            return this->signature;
+
+        for (int i = 0; i < this->k; i++)
+        {
+            if (this->buffers[(size_t)i * this->stride] != NUM_MAX)
+                continue;
+
+            // the probes of the i-th bin are a sequence of the generator with seed (seed, i)
+            uint64_t probeSeed = SplitMix64::at(this->seed, i);
+            for (uint64_t attempt = 0;; attempt++)
+            {
+                int j = (int)(((SplitMix64::at(probeSeed, attempt) >> 32) * this->k) >> 32);
+                if (this->buffers[(size_t)j * this->stride] != NUM_MAX)
+                {
+                    this->signature[i] = this->buffers[(size_t)j * this->stride];
+                    break;
+                }
+            }
+        }
+        return this->signature;
+    }
+
+    /**
+     * Static method that given two sketches (OPHKLMinhash) A & B returns the estimation of their jaccard similarity.
+     */
+    static double similarity(OPHKLMinhash *A, OPHKLMinhash *B)
+    {
+        num *sigA = A->getSignature();
+        num *sigB = B->getSignature();
+
+        return compare::jaccard(sigA, sigB, A->k);
+    }
+
+    /**
+     * Resets the buffer to default values.
+     */
+    void resetBuffer()
+    {
+        for (int i = 0; i < this->k; i++)
+            this->resetBin(i);
+    }
+
+    /**
+     * Resets the i-th bin to default values.
+     */
+    void resetBin(int i)
+    {
+        this->delta[i] = NUM_MAX;
+        for (int j = 0; j < this->l; j++)
+            this->buffers[(size_t)i * this->stride + j] = NUM_MAX;
+
+        this->signature[i] = NUM_MAX;
+    }
+};
+
+#endif
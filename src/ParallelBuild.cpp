@@ -0,0 +1,53 @@
+#ifndef PARALLELBUILD_H
+#define PARALLELBUILD_H
+
+#include <cstdint>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include "Sketch.cpp"
+#include "TreeKLMinhash.cpp"
+#include "ArrayKLMinhash.cpp"
+
+using namespace std;
+
+/**
+ * Builds the sketch S (TreeKLMinhash or ArrayKLMinhash) of the set xs[0], ..., xs[n-1] with n_threads threads.
+ * The set is split in n_threads contiguous parts, and every thread builds the sketch of its part (with the given seed).
+ * Then the sketches are merged (see merge) by a binary tree reduction: at every level the t-th sketch absorbs the (t + step)-th one,
+ * and the merges of the same level run in parallel, so the reduction takes log2(n_threads) levels of k row merges each.
+ * The result holds the same values in every buffer as the sketch built by inserting the whole set with the same seed.
+ * It is implicit (explicitSet false).
+ */
+template <class S>
+S *parallelBuild(const num *xs, size_t n, int k, int l, num U, uint64_t seed, int n_threads)
+{
+    vector<S *> parts(n_threads);
+    vector<std::thread> workers;
+
+    for (int t = 0; t < n_threads; t++)
+        workers.emplace_back([&, t]
+                             {
+                                 size_t begin = n * t / n_threads, end = n * (t + 1) / n_threads;
+                                 parts[t] = new S(k, l, U, false, seed);
+                                 for (size_t e = begin; e < end; e++)
+                                     parts[t]->insert(xs[e]); });
+    for (std::thread &w : workers)
+        w.join();
+
+    for (int step = 1; step < n_threads; step *= 2)
+    {
+        workers.clear();
+        for (int t = 0; t + step < n_threads; t += 2 * step)
+            workers.emplace_back([&, t]
+                                 {
+                                     parts[t]->merge(parts[t + step]);
+                                     delete parts[t + step]; });
+        for (std::thread &w : workers)
+            w.join();
+    }
+
+    return parts[0];
+}
+
+#endif
@@ -0,0 +1,397 @@
+#ifndef PARALLELKLMINHASH_H
+#define PARALLELKLMINHASH_H
+
+#include <cstdint>
+#include <stdlib.h>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "hash.cpp"
+#include "HashBank.cpp"
+#include "Sketch.cpp"
+#include "RecoveryStore.cpp"
+#include "TreeKLMinhash.cpp"
+#include "ArrayKLMinhash.cpp"
+#include "Similarity.cpp"
+
+using namespace std;
+
+/**
+ * Buffered k-MinHash sketch whose k rows are partitioned among a fixed pool of worker threads.
+ * The rows are independent, so the t-th worker owns a partition S (e.g. TreeKLMinhash or ArrayKLMinhash) with the rows
+ * first[t], ..., first[t + 1] - 1: the partition is allocated by the worker itself, so that its buffers are local to its core.
+ * The hash functions of a partition are the same slice of the k functions derived from the seed (see HashBank),
+ * so that the sketch is equivalent to a single sketch with the same seed, regardless of the number of threads.
+ *
+ * A batch of updates (applyBatch) is broadcast to all the workers, that apply it to their rows in parallel.
+ * A fault is global: if any row gets empty, every partition is reset and (if the set is explicit) the set is reinserted.
+ * The single updates (insert and remove) are applied by the calling thread, one partition after the other.
+ */
+template <class S = TreeKLMinhash>
+class ParallelKLMinhash : public Sketch
+{
+private:
+    /**
+     * Task broadcast to the workers
+     */
+    enum Task
+    {
+        BATCH,
+        RESET,
+        STOP
+    };
+
+    /**
+     * U: the maximum size of the set (aka the universe size)
+     */
+    num U;
+
+    /**
+     * k: number of hash functions and buffers in the signature
+     */
+    int k;
+
+    /**
+     * l: number of hash values for each buffer
+     */
+    int l;
+
+    /**
+     * seed: the seed of the k hash functions
+     */
+    uint64_t seed;
+
+    /**
+     * n_threads: the number of workers, i.e. of partitions
+     */
+    int n_threads;
+
+    /**
+     * first: the first row of each partition (first[n_threads] = k)
+     */
+    int *first;
+
+    /**
+     * parts, banks: the partitions and their hash functions, one for each worker
+     */
+    S **parts;
+    HashBank **banks;
+
+    /**
+     * faults: faults[t] is true if the last batch caused a fault in the t-th partition
+     */
+    bool *faults;
+
+    std::thread *workers;
+
+    /**
+     * The current task: it is published by incrementing generation, and it is complete when pending is zero.
+     */
+    std::mutex lock;
+    std::condition_variable started;
+    std::condition_variable completed;
+    uint64_t generation = 0;
+    int pending = 0;
+    Task task;
+    const num *batchElements;
+    const int8_t *batchOps;
+    size_t batchSize;
+
+    /**
+     * signature: the minhash signature, copied from the partitions by getSignature
+     */
+    num *signature;
+
+    /**
+     * explicitSet: if true, the set is explicitly stored
+     */
+    bool explicitSet;
+
+    /**
+     * elements: the set, stored only to recover the sketch after a fault (see setRecoveryStore)
+     */
+    RecoveryStore *elements = nullptr;
+
+    bool doFreeElements = true;
+
+    /**
+     * Body of the t-th worker: it builds its partition, then executes the broadcast tasks until STOP.
+     */
+    void work(int t)
+    {
+        int rows = this->first[t + 1] - this->first[t];
+        this->banks[t] = new HashBank(rows, this->seed, this->first[t]);
+        this->parts[t] = new S(rows, this->l, this->U, this->banks[t], false);
+        this->done();
+
+        uint64_t seen = 0;
+        while (true)
+        {
+            {
+                unique_lock<mutex> guard(this->lock);
+                this->started.wait(guard, [&]
+                                   { return this->generation != seen; });
+                seen = this->generation;
+            }
+
+            if (this->task == STOP)
+                break;
+
+            if (this->task == BATCH)
+                this->faults[t] = this->parts[t]->applyBatch(this->batchElements, this->batchOps, this->batchSize);
+            else
+                this->parts[t]->resetBuffer();
+
+            this->done();
+        }
+
+        delete this->parts[t];
+        delete this->banks[t];
+    }
+
+    /**
+     * Signals that the calling worker completed the current task
+     */
+    void done()
+    {
+        lock_guard<mutex> guard(this->lock);
+        if (--this->pending == 0)
+            this->completed.notify_one();
+    }
+
+    /**
+     * Broadcasts the task to all the workers, and waits for its completion (except for STOP)
+     */
+    void broadcast(Task task)
+    {
+        unique_lock<mutex> guard(this->lock);
+        this->task = task;
+        this->pending = this->n_threads;
+        this->generation++;
+        this->started.notify_all();
+
+        if (task != STOP)
+            this->completed.wait(guard, [&]
+                                 { return this->pending == 0; });
+    }
+
+    /**
+     * Pins the thread to the given core (only on Linux)
+     */
+    static void pin(std::thread &thread, int core)
+    {
+#ifdef __linux__
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(core % max(1u, std::thread::hardware_concurrency()), &cpus);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpus);
+#endif
+    }
+
+public:
+    // the workers keep a pointer to the sketch, so it is not rebuilt in place as the other sketches do
+    ParallelKLMinhash(int k, int l, num U, int n_threads, bool explicitSet = true)
+        : ParallelKLMinhash(k, l, U, n_threads, explicitSet, randomSeed()) {}
+
+    /**
+     * Constructor
+     * the rows are split evenly among the n_threads workers (clamped to [1, k], so that no partition is empty),
+     * each one pinned to its own core.
+     */
+    ParallelKLMinhash(int k, int l, num U, int n_threads, bool explicitSet, uint64_t seed)
+        : U(U), k(k), l(l), seed(seed), n_threads(max(1, min(n_threads, k))), explicitSet(explicitSet)
+    {
+        this->first = new int[this->n_threads + 1];
+        for (int t = 0; t <= this->n_threads; t++)
+            this->first[t] = (int)((int64_t)t * k / this->n_threads);
+
+        this->parts = new S *[this->n_threads];
+        this->banks = new HashBank *[this->n_threads];
+        this->faults = new bool[this->n_threads]();
+        this->signature = new num[k];
+        this->elements = explicitSet ? new FlatHashStore() : nullptr;
+
+        // the workers build their partitions before waiting for the first task
+        this->pending = this->n_threads;
+        this->workers = new std::thread[this->n_threads];
+        for (int t = 0; t < this->n_threads; t++)
+        {
+            this->workers[t] = std::thread(&ParallelKLMinhash::work, this, t);
+            pin(this->workers[t], t);
+        }
+
+        unique_lock<mutex> guard(this->lock);
+        this->completed.wait(guard, [&]
+                             { return this->pending == 0; });
+    }
+
+    ~ParallelKLMinhash()
+    {
+        this->broadcast(STOP);
+        for (int t = 0; t < this->n_threads; t++)
+            this->workers[t].join();
+
+        delete[] this->workers;
+        delete[] this->first;
+        delete[] this->parts;
+        delete[] this->banks;
+        delete[] this->faults;
+        delete[] this->signature;
+        if (this->doFreeElements)
+            delete this->elements;
+    }
+
+    void insert(num x)
+    {
+        this->insert(x, true);
+    }
+
+    /**
+     * Inserts x into the sketch.
+     * If insertIntoSet is true (default) and isExplicitSet flag is true, x is also explicitaly stored.
+     */
+    void insert(num x, bool insertIntoSet)
+    {
+        if (this->explicitSet && insertIntoSet)
+            this->elements->insert(x);
+
+        for (int t = 0; t < this->n_threads; t++)
+            this->parts[t]->insert(x, false);
+    }
+
+    /**
+     * Removes x from the sketch.
+     * If a fault occurs:
+     * - the method returns true
+     * - all the partitions are reset
+     * - if the explicitSet flag is true, all the elements are reinserted
+     * The method returns false otherwise
+     */
+    bool remove(num x)
+    {
+        if (this->explicitSet)
+            this->elements->erase(x);
+
+        for (int t = 0; t < this->n_threads; t++)
+            if (this->parts[t]->remove(x))
+                return this->recover();
+
+        return false;
+    }
+
+    /**
+     * Applies a batch of n updates: xs[i] is inserted if ops[i] > 0, and removed otherwise.
+     * The batch is applied by all the workers in parallel, each one to its rows.
+     * If a fault occurs in any partition:
+     * - the method returns true
+     * - all the partitions are reset
+     * - if the explicitSet flag is true, all the elements (after the whole batch) are reinserted,
+     *   otherwise the caller has to reinsert them
+     * The method returns false otherwise
+     */
+    bool applyBatch(const num *xs, const int8_t *ops, size_t n)
+    {
+        if (this->explicitSet)
+            for (size_t i = 0; i < n; i++)
+            {
+                if (ops[i] > 0)
+                    this->elements->insert(xs[i]);
+                else
+                    this->elements->erase(xs[i]);
+            }
+
+        this->batchElements = xs;
+        this->batchOps = ops;
+        this->batchSize = n;
+        this->broadcast(BATCH);
+
+        for (int t = 0; t < this->n_threads; t++)
+            if (this->faults[t])
+                return this->recover();
+
+        return false;
+    }
+
+    /**
+     * Recovers the sketch after a fault: all the partitions are reset and, if the explicitSet flag is true,
+     * all the elements are reinserted (as a single batch).
+     * Returns true, i.e. the result of the update that caused the fault.
+     */
+    bool recover()
+    {
+        this->resetBuffer();
+        if (this->explicitSet)
+            this->fault();
+
+        return true;
+    }
+
+    /**
+     * Reinserts all the elements in the sketch.
+     */
+    void fault()
+    {
+        vector<num> xs;
+        this->elements->forEach([&](num x)
+                                { xs.push_back(x); });
+        vector<int8_t> ops(xs.size(), 1);
+
+        this->batchElements = xs.data();
+        this->batchOps = ops.data();
+        this->batchSize = xs.size();
+        this->broadcast(BATCH);
+    }
+
+    /**
+     * Resets the buffers of all the partitions.
+     */
+    void resetBuffer()
+    {
+        this->broadcast(RESET);
+    }
+
+    /**
+     * Replaces the store of the set (by default a FlatHashStore, see RecoveryStore.cpp), copying the current elements into it.
+     * The sketch becomes explicit: e.g. with a CallbackStore the caller re-streams the set at every fault.
+     * If doFree is true the store is deleted with the sketch.
+     */
+    void setRecoveryStore(RecoveryStore *store, bool doFree = false)
+    {
+        if (this->elements != nullptr)
+        {
+            this->elements->forEach([&](num x)
+                                    { store->insert(x); });
+            if (this->doFreeElements)
+                delete this->elements;
+        }
+
+        this->elements = store;
+        this->doFreeElements = doFree;
+        this->explicitSet = true;
+    }
+
+    /**
+     * Returns the k-minhash signature
+     */
+    num *getSignature()
+    {
+        for (int t = 0; t < this->n_threads; t++)
+            memcpy(this->signature + this->first[t], this->parts[t]->getSignature(), (this->first[t + 1] - this->first[t]) * sizeof(num));
+        return this->signature;
+    }
+
+    /**
+     * Static method that given two sketches (ParallelKLMinhash) A & B returns the estimation of their jaccard similarity.
+     */
+    static double similarity(ParallelKLMinhash *A, ParallelKLMinhash *B)
+    {
+        return compare::jaccard(A->getSignature(), B->getSignature(), A->k);
+    }
+};
+
+#endif
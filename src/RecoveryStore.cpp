@@ -0,0 +1,476 @@
+#ifndef RECOVERYSTORE_H
+#define RECOVERYSTORE_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdlib.h>
+#include <functional>
+#include <unordered_set>
+#include <vector>
+#include <algorithm>
+#include "Sketch.cpp"
+
+using namespace std;
+
+/**
+ * Explicit copy of the set summarized by a sketch, used only to recover the sketch after a fault.
+ * The sketches call insert and erase on every update, and forEach to reinsert all the elements.
+ */
+class RecoveryStore
+{
+public:
+    virtual ~RecoveryStore() {}
+
+    virtual void insert(num x) = 0;
+    virtual void erase(num x) = 0;
+
+    /**
+     * Calls f on every element of the set
+     */
+    virtual void forEach(const function<void(num)> &f) = 0;
+
+    /**
+     * Returns the number of elements (0 if the store does not know it)
+     */
+    virtual size_t size() = 0;
+
+    /**
+     * Returns the number of bytes used by the store (an estimate for the stores based on the standard library)
+     */
+    virtual size_t bytes() = 0;
+};
+
+/**
+ * Store backed by std::unordered_set: one node (allocated on every insertion) per element, plus the buckets.
+ */
+class HashSetStore final : public RecoveryStore
+{
+private:
+    std::unordered_set<num> elements;
+
+public:
+    void insert(num x)
+    {
+        this->elements.insert(x);
+    }
+
+    void erase(num x)
+    {
+        this->elements.erase(x);
+    }
+
+    void forEach(const function<void(num)> &f)
+    {
+        for (num x : this->elements)
+            f(x);
+    }
+
+    size_t size()
+    {
+        return this->elements.size();
+    }
+
+    /**
+     * A node holds the element and the next pointer, and costs 32 bytes with the overhead of malloc
+     */
+    size_t bytes()
+    {
+        return this->elements.size() * 32 + this->elements.bucket_count() * sizeof(void *);
+    }
+};
+
+/**
+ * Open addressing hash set with linear probing, stored in a single array of 4 bytes per slot (load factor at most 1/2).
+ * The empty slots hold 0, so the element 0 is kept apart in a flag.
+ * Deletions shift back the following elements of the cluster, so that no tombstone is needed.
+ */
+class FlatHashStore final : public RecoveryStore
+{
+private:
+    num *slots;
+
+    /**
+     * capacity: the number of slots (a power of 2), mask = capacity - 1
+     */
+    size_t capacity;
+    size_t mask;
+
+    /**
+     * n: the number of elements, hasZero: true if the element 0 is in the set
+     */
+    size_t n = 0;
+    bool hasZero = false;
+
+    size_t slot(num x)
+    {
+        // Fibonacci hashing: the high bits of the product are the best mixed
+        return (size_t)(((uint64_t)x * 0x9e3779b97f4a7c15ull) >> 32) & this->mask;
+    }
+
+    void grow()
+    {
+        num *old = this->slots;
+        size_t oldCapacity = this->capacity;
+
+        this->capacity *= 2;
+        this->mask = this->capacity - 1;
+        this->slots = (num *)calloc(this->capacity, sizeof(num));
+
+        for (size_t i = 0; i < oldCapacity; i++)
+            if (old[i] != 0)
+            {
+                size_t j = this->slot(old[i]);
+                while (this->slots[j] != 0)
+                    j = (j + 1) & this->mask;
+                this->slots[j] = old[i];
+            }
+
+        free(old);
+    }
+
+public:
+    FlatHashStore(size_t capacity = 16)
+    {
+        this->capacity = 16;
+        while (this->capacity < 2 * capacity)
+            this->capacity *= 2;
+        this->mask = this->capacity - 1;
+        this->slots = (num *)calloc(this->capacity, sizeof(num));
+    }
+
+    ~FlatHashStore()
+    {
+        free(this->slots);
+    }
+
+    void insert(num x)
+    {
+        if (x == 0)
+        {
+            this->n += !this->hasZero;
+            this->hasZero = true;
+            return;
+        }
+
+        size_t i = this->slot(x);
+        while (this->slots[i] != 0)
+        {
+            if (this->slots[i] == x)
+                return;
+            i = (i + 1) & this->mask;
+        }
+
+        this->slots[i] = x;
+        this->n++;
+        if (2 * this->n > this->capacity)
+            this->grow();
+    }
+
+    void erase(num x)
+    {
+        if (x == 0)
+        {
+            this->n -= this->hasZero;
+            this->hasZero = false;
+            return;
+        }
+
+        size_t i = this->slot(x);
+        while (this->slots[i] != x)
+        {
+            if (this->slots[i] == 0)
+                return;
+            i = (i + 1) & this->mask;
+        }
+
+        // backward shift: every following element of the cluster that can be moved to the hole is moved
+        size_t j = i;
+        while (true)
+        {
+            j = (j + 1) & this->mask;
+            if (this->slots[j] == 0)
+                break;
+
+            size_t home = this->slot(this->slots[j]);
+            // the element at j can fill the hole at i iff its home is not in the cyclic interval (i, j]
+            if (((j - home) & this->mask) >= ((j - i) & this->mask))
+            {
+                this->slots[i] = this->slots[j];
+                i = j;
+            }
+        }
+
+        this->slots[i] = 0;
+        this->n--;
+    }
+
+    void forEach(const function<void(num)> &f)
+    {
+        if (this->hasZero)
+            f(0);
+        for (size_t i = 0; i < this->capacity; i++)
+            if (this->slots[i] != 0)
+                f(this->slots[i]);
+    }
+
+    size_t size()
+    {
+        return this->n;
+    }
+
+    size_t bytes()
+    {
+        return this->capacity * sizeof(num);
+    }
+};
+
+/**
+ * Compressed bitmap, in the style of Roaring bitmaps.
+ * The universe is split in chunks of 2^16 values, identified by the 16 high bits of the elements.
+ * A chunk stores the 16 low bits of its elements in a sorted array of uint16_t while it has at most 4096 elements,
+ * and in a bitmap of 2^16 bits (8 KB) otherwise: in both cases it takes at most 2 bytes per element.
+ * While there are few chunks, they are found by binary search in a sorted array of their keys (4 bytes per chunk, as in Roaring),
+ * so that a small set takes a few bytes; past INDEX_MIN chunks a direct index on the high bits (256 KB) replaces the array,
+ * so that a new chunk is created in constant time even when the set is large and sparse.
+ */
+class BitmapStore final : public RecoveryStore
+{
+private:
+    static const int ARRAY_MAX = 4096;
+    static const int INDEX_MIN = 4096;
+
+    struct Container
+    {
+        uint16_t key;
+        /**
+         * cardinality: the number of elements of the chunk
+         */
+        int cardinality;
+        /**
+         * values: the sorted low bits (array container), bits: the bitmap (bitmap container, nullptr otherwise)
+         */
+        vector<uint16_t> values;
+        uint64_t *bits;
+    };
+
+    vector<Container> containers;
+
+    /**
+     * keys: the keys of the containers with their position (key << 16 | position), sorted, while there is no index
+     * index: index[key] is the position of the container with the given key plus one, or 0 if there is no such container
+     * (nullptr until there are INDEX_MIN containers)
+     */
+    vector<uint32_t> keys;
+    uint32_t *index = nullptr;
+
+    size_t n = 0;
+
+    /**
+     * Returns the position of the container with the given key, or -1 if there is no such container
+     */
+    int position(uint16_t key)
+    {
+        if (this->index != nullptr)
+            return (int)this->index[key] - 1;
+
+        auto it = lower_bound(this->keys.begin(), this->keys.end(), (uint32_t)key << 16);
+        return it != this->keys.end() && (*it >> 16) == key ? (int)(*it & 0xffff) : -1;
+    }
+
+    /**
+     * Sets the position of the container with the given key (-1 to remove the key)
+     */
+    void setPosition(uint16_t key, int p)
+    {
+        if (this->index != nullptr)
+        {
+            this->index[key] = p + 1;
+            return;
+        }
+
+        auto it = lower_bound(this->keys.begin(), this->keys.end(), (uint32_t)key << 16);
+        bool found = it != this->keys.end() && (*it >> 16) == key;
+        if (p < 0)
+        {
+            if (found)
+                this->keys.erase(it);
+        }
+        else if (found)
+            *it = (uint32_t)key << 16 | p;
+        else
+            this->keys.insert(it, (uint32_t)key << 16 | p);
+    }
+
+    static void toBitmap(Container &c)
+    {
+        c.bits = (uint64_t *)calloc(1 << 10, sizeof(uint64_t));
+        for (uint16_t v : c.values)
+            c.bits[v >> 6] |= 1ull << (v & 63);
+        c.values = vector<uint16_t>();
+    }
+
+    static void toArray(Container &c)
+    {
+        c.values.reserve(c.cardinality);
+        for (int w = 0; w < (1 << 10); w++)
+            for (uint64_t m = c.bits[w]; m != 0; m &= m - 1)
+                c.values.push_back((uint16_t)(w * 64 + __builtin_ctzll(m)));
+        free(c.bits);
+        c.bits = nullptr;
+    }
+
+public:
+    ~BitmapStore()
+    {
+        for (Container &c : this->containers)
+            free(c.bits);
+        free(this->index);
+    }
+
+    void insert(num x)
+    {
+        uint16_t key = x >> 16, low = x & 0xffff;
+        int p = this->position(key);
+        if (p < 0)
+        {
+            p = this->containers.size();
+            this->containers.push_back(Container{key, 0, vector<uint16_t>(), nullptr});
+            this->setPosition(key, p);
+
+            if (this->index == nullptr && this->containers.size() >= INDEX_MIN)
+            {
+                this->index = (uint32_t *)calloc(1 << 16, sizeof(uint32_t));
+                for (uint32_t e : this->keys)
+                    this->index[e >> 16] = (e & 0xffff) + 1;
+                this->keys = vector<uint32_t>();
+            }
+        }
+
+        Container &c = this->containers[p];
+        if (c.bits != nullptr)
+        {
+            uint64_t bit = 1ull << (low & 63);
+            if (c.bits[low >> 6] & bit)
+                return;
+            c.bits[low >> 6] |= bit;
+        }
+        else
+        {
+            auto it = lower_bound(c.values.begin(), c.values.end(), low);
+            if (it != c.values.end() && *it == low)
+                return;
+            c.values.insert(it, low);
+        }
+
+        c.cardinality++;
+        this->n++;
+        if (c.bits == nullptr && c.cardinality > ARRAY_MAX)
+            toBitmap(c);
+    }
+
+    void erase(num x)
+    {
+        uint16_t key = x >> 16, low = x & 0xffff;
+        int p = this->position(key);
+        if (p < 0)
+            return;
+
+        Container &c = this->containers[p];
+        if (c.bits != nullptr)
+        {
+            uint64_t bit = 1ull << (low & 63);
+            if (!(c.bits[low >> 6] & bit))
+                return;
+            c.bits[low >> 6] &= ~bit;
+        }
+        else
+        {
+            auto it = lower_bound(c.values.begin(), c.values.end(), low);
+            if (it == c.values.end() || *it != low)
+                return;
+            c.values.erase(it);
+        }
+
+        c.cardinality--;
+        this->n--;
+        if (c.cardinality == 0)
+        {
+            // the last container takes the place of the empty one
+            free(c.bits);
+            this->setPosition(key, -1);
+            if (p != (int)this->containers.size() - 1)
+            {
+                c = std::move(this->containers.back());
+                this->setPosition(c.key, p);
+            }
+            this->containers.pop_back();
+        }
+        else if (c.bits != nullptr && c.cardinality <= ARRAY_MAX / 2)
+            toArray(c);
+    }
+
+    void forEach(const function<void(num)> &f)
+    {
+        for (Container &c : this->containers)
+        {
+            num high = (num)c.key << 16;
+            if (c.bits != nullptr)
+            {
+                for (int w = 0; w < (1 << 10); w++)
+                    for (uint64_t m = c.bits[w]; m != 0; m &= m - 1)
+                        f(high | (num)(w * 64 + __builtin_ctzll(m)));
+            }
+            else
+                for (uint16_t v : c.values)
+                    f(high | v);
+        }
+    }
+
+    size_t size()
+    {
+        return this->n;
+    }
+
+    size_t bytes()
+    {
+        size_t res = (this->index != nullptr ? (1 << 16) * sizeof(uint32_t) : this->keys.capacity() * sizeof(uint32_t)) +
+                     this->containers.capacity() * sizeof(Container);
+        for (Container &c : this->containers)
+            res += c.bits != nullptr ? (1 << 13) : c.values.capacity() * sizeof(uint16_t);
+        return res;
+    }
+};
+
+/**
+ * Store that does not keep any copy of the set: the elements are re-streamed by the caller, from its own storage,
+ * through the given function (called with the function to apply to every element).
+ */
+class CallbackStore final : public RecoveryStore
+{
+private:
+    function<void(const function<void(num)> &)> stream;
+
+public:
+    CallbackStore(function<void(const function<void(num)> &)> stream) : stream(stream) {}
+
+    void insert(num x) {}
+
+    void erase(num x) {}
+
+    void forEach(const function<void(num)> &f)
+    {
+        this->stream(f);
+    }
+
+    size_t size()
+    {
+        return 0;
+    }
+
+    size_t bytes()
+    {
+        return 0;
+    }
+};
+
+#endif
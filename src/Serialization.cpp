@@ -0,0 +1,441 @@
+#ifndef SERIALIZATION_H
+#define SERIALIZATION_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Sketch.cpp"
+#include "Similarity.cpp"
+
+using namespace std;
+
+/**
+ * Binary format of the KLMinhash sketches (version 1).
+ * Every integer is stored little endian, whatever the byte order of the host.
+ *
+ * A sketch is stored as a record of a 48 bytes header (SketchRecord) followed by the arrays of the sketch:
+ * delta (k values), the signature (k values) and the k rows. A row of a TreeKLMinhash is its sorted buffer (l values),
+ * a row of an ArrayKLMinhash is its minimum, its size and its buffer (l values, only the first size are meaningful).
+ * The record is padded to a multiple of 8 bytes.
+ * The hash functions are not stored: they are derived again from the seed, so that loading a sketch does not rehash any element.
+ *
+ * A file of sketches (see SketchFileWriter) is a sequence of records, followed by the table of their offsets (8 bytes each)
+ * and by a trailer (SketchFileTrailer): a MappedSketchFile opens it in constant time, reading only the trailer.
+ */
+
+namespace serialization
+{
+    /**
+     * Converts between the byte order of the host and little endian (in both directions)
+     */
+    inline uint32_t le32(uint32_t x)
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return __builtin_bswap32(x);
+#else
+        return x;
+#endif
+    }
+
+    inline uint64_t le64(uint64_t x)
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return __builtin_bswap64(x);
+#else
+        return x;
+#endif
+    }
+
+    static const uint32_t VERSION = 1;
+
+    /**
+     * The largest k, l and k * l of a record: the header of a record is checked against them before anything is allocated
+     */
+    static const int MAX_K = 1 << 20;
+    static const int MAX_L = 1 << 16;
+    static const uint64_t MAX_VALUES = 1ull << 28;
+
+    /**
+     * kind: the sketch stored in a record
+     */
+    enum Kind : uint32_t
+    {
+        TREE = 1,
+        ARRAY = 2
+    };
+
+    /**
+     * family: how the hash functions are derived from the seed
+     * - TABULATION: the functions first, ..., first + k - 1 of HashBank(seed)
+     * - SEEDED_TABULATION, SEEDED_PAIRWISE: the functions of the sketch templated on TabulationHash<num> (resp. PairWiseHash<num>)
+     *   built with the seed (see the seed constructor of the sketches)
+     */
+    enum Family : uint32_t
+    {
+        TABULATION = 1,
+        SEEDED_TABULATION = 2,
+        SEEDED_PAIRWISE = 3
+    };
+}
+
+/**
+ * Header of a record, as stored in the file (little endian)
+ */
+struct SketchRecord
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t kind;
+    uint32_t family;
+    uint32_t k;
+    uint32_t l;
+    uint32_t U;
+    uint32_t first;
+    uint64_t seed;
+    /**
+     * size: the number of bytes of the record, header and padding included
+     */
+    uint64_t size;
+};
+
+static_assert(sizeof(SketchRecord) == 48, "the header of a record must take 48 bytes");
+
+/**
+ * Trailer of a file of sketches, as stored in the file (little endian)
+ */
+struct SketchFileTrailer
+{
+    uint64_t count;
+    uint64_t table;
+    char magic[8];
+};
+
+/**
+ * Read-only view of a record in memory (e.g. in a MappedSketchFile): the values are decoded on access, nothing is copied.
+ * It supports the queries on the signature, and it is used by the sketches to load a record.
+ */
+class SketchView
+{
+private:
+    const SketchRecord *record;
+    const num *data;
+
+public:
+    SketchView() : record(nullptr), data(nullptr) {}
+
+    SketchView(const void *record) : record((const SketchRecord *)record), data((const num *)((const char *)record + sizeof(SketchRecord))) {}
+
+    /**
+     * Returns true if the view points to a record of a known version, whose k and l are in the supported range (see MAX_K and MAX_L)
+     */
+    bool valid()
+    {
+        if (this->record == nullptr || memcmp(this->record->magic, "KLMH", 4) != 0 ||
+            serialization::le32(this->record->version) != serialization::VERSION)
+            return false;
+
+        uint32_t k = serialization::le32(this->record->k);
+        uint32_t l = serialization::le32(this->record->l);
+        return k >= 1 && k <= (uint32_t)serialization::MAX_K && l >= 1 && l <= (uint32_t)serialization::MAX_L &&
+               (uint64_t)k * l <= serialization::MAX_VALUES;
+    }
+
+    uint32_t kind() { return serialization::le32(this->record->kind); }
+    uint32_t family() { return serialization::le32(this->record->family); }
+    int k() { return serialization::le32(this->record->k); }
+    int l() { return serialization::le32(this->record->l); }
+    num U() { return serialization::le32(this->record->U); }
+    int first() { return serialization::le32(this->record->first); }
+    uint64_t seed() { return serialization::le64(this->record->seed); }
+    uint64_t size() { return serialization::le64(this->record->size); }
+
+    /**
+     * Returns the number of values of a row
+     */
+    int rowSize()
+    {
+        return this->kind() == serialization::ARRAY ? this->l() + 2 : this->l();
+    }
+
+    num delta(int i)
+    {
+        return serialization::le32(this->data[i]);
+    }
+
+    num signature(int i)
+    {
+        return serialization::le32(this->data[this->k() + i]);
+    }
+
+    /**
+     * Returns the j-th value of the i-th row
+     */
+    num row(int i, int j)
+    {
+        return serialization::le32(this->data[2 * (size_t)this->k() + (size_t)i * this->rowSize() + j]);
+    }
+
+    /**
+     * Returns the number of bytes of a record with the given parameters
+     */
+    static uint64_t recordSize(uint32_t kind, int k, int l)
+    {
+        int rowSize = kind == serialization::ARRAY ? l + 2 : l;
+        uint64_t bytes = sizeof(SketchRecord) + ((uint64_t)2 * k + (uint64_t)k * rowSize) * sizeof(num);
+        return (bytes + 7) & ~7ull;
+    }
+
+    /**
+     * Returns the estimation of the jaccard similarity of the sketches of the two views
+     */
+    static double similarity(SketchView A, SketchView B)
+    {
+        int k = A.k();
+        return compare::jaccard(A.data + k, B.data + k, k);
+    }
+};
+
+/**
+ * Writer of a record: the sketches fill the header and then write their arrays one value at a time, in the order of the format.
+ */
+class SketchRecordWriter
+{
+private:
+    ostream &out;
+    uint64_t written = 0;
+    uint64_t size;
+
+public:
+    SketchRecordWriter(ostream &out, uint32_t kind, uint32_t family, int k, int l, num U, int first, uint64_t seed) : out(out)
+    {
+        this->size = SketchView::recordSize(kind, k, l);
+
+        SketchRecord r;
+        memcpy(r.magic, "KLMH", 4);
+        r.version = serialization::le32(serialization::VERSION);
+        r.kind = serialization::le32(kind);
+        r.family = serialization::le32(family);
+        r.k = serialization::le32(k);
+        r.l = serialization::le32(l);
+        r.U = serialization::le32(U);
+        r.first = serialization::le32(first);
+        r.seed = serialization::le64(seed);
+        r.size = serialization::le64(this->size);
+        this->out.write((const char *)&r, sizeof(r));
+        this->written = sizeof(r);
+    }
+
+    void write(const num *values, size_t n)
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        for (size_t i = 0; i < n; i++)
+            this->write(values[i]);
+#else
+        this->out.write((const char *)values, n * sizeof(num));
+        this->written += n * sizeof(num);
+#endif
+    }
+
+    void write(num value)
+    {
+        value = serialization::le32(value);
+        this->out.write((const char *)&value, sizeof(num));
+        this->written += sizeof(num);
+    }
+
+    /**
+     * Writes the padding of the record. Returns true if the stream is still good.
+     */
+    bool close()
+    {
+        static const char zeros[8] = {0};
+        this->out.write(zeros, this->size - this->written);
+        return this->out.good();
+    }
+};
+
+/**
+ * Reads the next record of the stream into data (header included), and returns its view (an invalid view at the end of the stream
+ * or if the record is malformed). The view points into data.
+ */
+inline SketchView readRecord(istream &in, vector<uint64_t> &data)
+{
+    SketchRecord r;
+    if (!in.read((char *)&r, sizeof(r)))
+        return SketchView();
+
+    SketchView header(&r);
+    uint64_t size = header.size();
+    if (!header.valid() || size != SketchView::recordSize(header.kind(), header.k(), header.l()))
+        return SketchView();
+
+    // the record is copied into 8 bytes words, so that its arrays are aligned
+    data.resize(size / 8);
+    memcpy(data.data(), &r, sizeof(r));
+    if (!in.read((char *)data.data() + sizeof(r), size - sizeof(r)))
+        return SketchView();
+
+    return SketchView(data.data());
+}
+
+/**
+ * Writer of a file of sketches: the sketches (TreeKLMinhash or ArrayKLMinhash) are appended one at a time by add,
+ * and finish writes the table of the offsets. The stream must be opened in binary mode.
+ */
+class SketchFileWriter
+{
+private:
+    ostream &out;
+    streampos start;
+    vector<uint64_t> offsets;
+
+public:
+    SketchFileWriter(ostream &out) : out(out)
+    {
+        this->start = out.tellp();
+    }
+
+    /**
+     * Appends the sketch. Returns false if it cannot be saved (see the save method of the sketches).
+     */
+    template <class S>
+    bool add(S *sketch)
+    {
+        uint64_t offset = (uint64_t)(this->out.tellp() - this->start);
+        if (!sketch->save(this->out))
+            return false;
+
+        this->offsets.push_back(offset);
+        return true;
+    }
+
+    /**
+     * Writes the table of the offsets and the trailer. Returns true if the stream is still good.
+     */
+    bool finish()
+    {
+        SketchFileTrailer trailer;
+        trailer.count = serialization::le64(this->offsets.size());
+        trailer.table = serialization::le64((uint64_t)(this->out.tellp() - this->start));
+        memcpy(trailer.magic, "KLMSTORE", 8);
+
+        for (uint64_t offset : this->offsets)
+        {
+            uint64_t value = serialization::le64(offset);
+            this->out.write((const char *)&value, sizeof(value));
+        }
+        this->out.write((const char *)&trailer, sizeof(trailer));
+        return this->out.good();
+    }
+};
+
+/**
+ * Read-only memory mapping of a file of sketches (see SketchFileWriter), for the query-only use:
+ * it is opened in constant time (only the trailer is read), and the i-th sketch is a view on the mapping.
+ * The pages of the file are read on demand by the kernel, and they are shared by all the processes that map the file.
+ */
+class MappedSketchFile
+{
+private:
+    const char *base = nullptr;
+    size_t length = 0;
+    uint64_t count = 0;
+    const uint64_t *table = nullptr;
+
+public:
+    /**
+     * Maps the file. If the file cannot be mapped or it is not a file of sketches, isOpen returns false.
+     */
+    MappedSketchFile(const string &fileName)
+    {
+        int fd = open(fileName.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(SketchFileTrailer))
+        {
+            void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                this->base = (const char *)p;
+                this->length = st.st_size;
+            }
+        }
+        close(fd);
+
+        if (this->base == nullptr)
+            return;
+
+        const SketchFileTrailer *trailer = (const SketchFileTrailer *)(this->base + this->length - sizeof(SketchFileTrailer));
+        uint64_t count = serialization::le64(trailer->count);
+        uint64_t table = serialization::le64(trailer->table);
+        if (memcmp(trailer->magic, "KLMSTORE", 8) != 0 || table % 8 != 0 || count > this->length / sizeof(uint64_t) ||
+            table + count * sizeof(uint64_t) + sizeof(SketchFileTrailer) != this->length)
+        {
+            this->unmap();
+            return;
+        }
+
+        this->count = count;
+        this->table = (const uint64_t *)(this->base + table);
+    }
+
+    // the mapping is owned by the object, which cannot be copied (a copy would unmap it twice)
+    MappedSketchFile(const MappedSketchFile &) = delete;
+    MappedSketchFile &operator=(const MappedSketchFile &) = delete;
+
+    ~MappedSketchFile()
+    {
+        this->unmap();
+    }
+
+    void unmap()
+    {
+        if (this->base != nullptr)
+            munmap((void *)this->base, this->length);
+        this->base = nullptr;
+        this->count = 0;
+    }
+
+    bool isOpen()
+    {
+        return this->base != nullptr;
+    }
+
+    /**
+     * Returns the number of sketches in the file
+     */
+    size_t size()
+    {
+        return this->count;
+    }
+
+    /**
+     * Returns the view of the i-th sketch (an invalid view if i >= size(), or if the record is malformed or out of the file)
+     */
+    SketchView get(size_t i)
+    {
+        if (i >= this->count)
+            return SketchView();
+
+        uint64_t offset = serialization::le64(this->table[i]);
+        if (offset % 8 != 0 || this->length < sizeof(SketchRecord) || offset > this->length - sizeof(SketchRecord))
+            return SketchView();
+
+        SketchView view(this->base + offset);
+        if (!view.valid() || view.size() != SketchView::recordSize(view.kind(), view.k(), view.l()) ||
+            offset + view.size() > this->length)
+            return SketchView();
+        return view;
+    }
+};
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef SIMILARITY_H
+#define SIMILARITY_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdlib.h>
+#include <immintrin.h>
+#include "Sketch.cpp"
+
+using namespace std;
+
+/**
+ * Kernels that compare minhash signatures (k values of 32 bits, e.g. the result of getSignature).
+ * The values are compared 16 (AVX-512) or 8 (AVX2) at a time, and the equal ones are counted by a popcount of the comparison mask,
+ * with an integer counter: the estimation is exactly the one of the scalar loop with the double accumulator.
+ */
+namespace compare
+{
+    /**
+     * Returns the number of indices i in [0, k) such that a[i] == b[i]
+     */
+    inline int countEqual(const num *a, const num *b, int k)
+    {
+        int c = 0, i = 0;
+#if defined(__AVX512F__)
+        for (; i + 16 <= k; i += 16)
+            c += __builtin_popcount(_mm512_cmpeq_epi32_mask(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i)));
+#elif defined(__AVX2__)
+        for (; i + 8 <= k; i += 8)
+        {
+            __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(a + i)), _mm256_loadu_si256((const __m256i *)(b + i)));
+            c += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(eq)));
+        }
+#endif
+        for (; i < k; i++)
+            c += a[i] == b[i];
+        return c;
+    }
+
+    /**
+     * Returns the estimation of the jaccard similarity of the two signatures a and b of k values
+     */
+    inline double jaccard(const num *a, const num *b, int k)
+    {
+        return countEqual(a, b, k) / static_cast<double>(k);
+    }
+
+    /**
+     * Compares the query signature (k values) with the n signatures of block, the i-th starting at block[i * stride] (stride >= k),
+     * and writes the estimation of the jaccard similarity with the i-th signature in out[i].
+     * The block is read once, sequentially, while the query stays in the L1 cache: for the AVX-512 kernel, 4 signatures are compared
+     * at the same time, so that every 64 bytes of the query loaded from the cache are compared with 256 bytes of the block.
+     */
+    inline void oneVsMany(const num *query, const num *block, size_t n, int k, size_t stride, double *out)
+    {
+        size_t r = 0;
+#if defined(__AVX512F__)
+        for (; r + 4 <= n; r += 4)
+        {
+            const num *b0 = block + r * stride, *b1 = b0 + stride, *b2 = b1 + stride, *b3 = b2 + stride;
+            int c0 = 0, c1 = 0, c2 = 0, c3 = 0, i = 0;
+            for (; i + 16 <= k; i += 16)
+            {
+                __m512i q = _mm512_loadu_si512(query + i);
+                c0 += __builtin_popcount(_mm512_cmpeq_epi32_mask(q, _mm512_loadu_si512(b0 + i)));
+                c1 += __builtin_popcount(_mm512_cmpeq_epi32_mask(q, _mm512_loadu_si512(b1 + i)));
+                c2 += __builtin_popcount(_mm512_cmpeq_epi32_mask(q, _mm512_loadu_si512(b2 + i)));
+                c3 += __builtin_popcount(_mm512_cmpeq_epi32_mask(q, _mm512_loadu_si512(b3 + i)));
+            }
+            for (; i < k; i++)
+            {
+                c0 += query[i] == b0[i];
+                c1 += query[i] == b1[i];
+                c2 += query[i] == b2[i];
+                c3 += query[i] == b3[i];
+            }
+            out[r] = c0 / static_cast<double>(k);
+            out[r + 1] = c1 / static_cast<double>(k);
+            out[r + 2] = c2 / static_cast<double>(k);
+            out[r + 3] = c3 / static_cast<double>(k);
+        }
+#endif
+        for (; r < n; r++)
+            out[r] = countEqual(query, block + r * stride, k) / static_cast<double>(k);
+    }
+}
+
+/**
+ * Contiguous block of n signatures of k values, for the one-vs-many queries (see compare::oneVsMany).
+ * Every signature is padded to a multiple of 16 values (64 bytes), and the block is 64-byte aligned.
+ */
+class SignatureBlock
+{
+private:
+    /**
+     * n: the number of signatures
+     */
+    size_t n;
+
+    /**
+     * k: the number of values of a signature
+     */
+    int k;
+
+    /**
+     * stride: k rounded up to a multiple of 16, i.e. the distance between two consecutive signatures
+     */
+    size_t stride;
+
+    /**
+     * data: the signatures, the i-th starts at data[i * stride] (the padding values are NUM_MAX)
+     */
+    num *data;
+
+public:
+    SignatureBlock(size_t n, int k) : n(n), k(k)
+    {
+        this->stride = ((size_t)k + 15) & ~(size_t)15;
+        this->data = (num *)aligned_alloc(64, this->n * this->stride * sizeof(num));
+        for (size_t i = 0; i < this->n * this->stride; i++)
+            this->data[i] = NUM_MAX;
+    }
+
+    ~SignatureBlock()
+    {
+        free(this->data);
+    }
+
+    /**
+     * Copies the signature (k values) into the i-th signature of the block
+     */
+    void set(size_t i, const num *signature)
+    {
+        memcpy(this->data + i * this->stride, signature, this->k * sizeof(num));
+    }
+
+    /**
+     * Copies the signature of the sketch (TreeKLMinhash, ArrayKLMinhash, OPHKLMinhash, ...) into the i-th signature of the block
+     */
+    template <class S>
+    void setSketch(size_t i, S *sketch)
+    {
+        this->set(i, sketch->getSignature());
+    }
+
+    /**
+     * Returns the i-th signature
+     */
+    const num *get(size_t i)
+    {
+        return this->data + i * this->stride;
+    }
+
+    size_t size()
+    {
+        return this->n;
+    }
+
+    int getK()
+    {
+        return this->k;
+    }
+
+    /**
+     * Returns the number of bytes of the block
+     */
+    size_t bytes()
+    {
+        return this->n * this->stride * sizeof(num);
+    }
+
+    /**
+     * Writes in out[i - begin] the estimation of the jaccard similarity of the query signature (k values) with the i-th signature,
+     * for every i in [begin, end).
+     */
+    void query(const num *query, double *out, size_t begin, size_t end)
+    {
+        compare::oneVsMany(query, this->data + begin * this->stride, end - begin, this->k, this->stride, out);
+    }
+
+    /**
+     * Writes in out[i] the estimation of the jaccard similarity of the query signature with the i-th signature, for all the n signatures.
+     */
+    void query(const num *query, double *out)
+    {
+        this->query(query, out, 0, this->n);
+    }
+};
+
+#endif
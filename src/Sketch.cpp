@@ -5,6 +5,7 @@
 #define NUM_MAX UINT32_MAX
 
 #include <cstdint>
+#include <cstddef>
 
 class Sketch
 {
@@ -12,6 +13,30 @@ public:
     virtual void insert(num) {}
     virtual bool remove(num) { return false; }
 
+    /**
+     * Applies a batch of n updates: xs[i] is inserted if ops[i] > 0, and removed otherwise.
+     * Returns true if a fault occurs while processing the batch.
+     * The sketches override it to process the whole batch one hash function at a time,
+     * and to recover from the faults only once, at the end of the batch.
+     */
+    virtual bool applyBatch(const num *xs, const int8_t *ops, size_t n)
+    {
+        bool fault = false;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (ops[i] > 0)
+                this->insert(xs[i]);
+            else
+                fault |= this->remove(xs[i]);
+        }
+        return fault;
+    }
+
+    /**
+     * Returns true if the sketch is recovering from a fault in background, i.e. if its signature is not exact yet
+     */
+    virtual bool isRecovering() { return false; }
+
     virtual uint32_t *getSignature()
     {
         return nullptr;
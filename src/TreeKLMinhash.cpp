@@ -2,261 +2,310 @@
 #define TREEKLMINHASH_H
 
 #include <cstdint>
-#include <iostream>
 #include <stdlib.h>
-#include <unordered_set>
-#include <bits/stdc++.h>
-#include "hash.cpp"
-#include "Sketch.cpp"
+#include "KLMinhash.cpp"
 
 using namespace std;
 
 #define num uint32_t
 #define NUM_MAX UINT32_MAX
 
-class TreeKLMinhash : public Sketch
+/**
+ * Every buffer is a sorted array of l hash values (padded with NUM_MAX), so that the minimum and the maximum of the buffer
+ * are its first and its last entry.
+ * An update finds its position by binary search and shifts the following entries by one with a memmove,
+ * which for the values of l used in the experiments is faster than rebalancing a tree of l nodes.
+ *
+ * All the data of the sketch lives in a single 64-byte aligned arena (see allocate): the delta array, read (16 rows per cache line)
+ * by the bank to reject the rows that are not updated, the scratch space of the bank, the signature and the k buffers,
+ * each one 64-byte aligned. The buffers need no header, since their minimum is their first entry.
+ *
+ * The updates, the recovery, the hash memo and the serialization are implemented by BasicKLMinhash, on the primitives of the buffers below.
+ *
+ * The sketch is templated on the family H of its k hash functions.
+ * TreeKLMinhash (i.e. BasicTreeKLMinhash<Hash<num>>) is the type-erased version, in which every hash evaluation is a virtual call.
+ * BasicTreeKLMinhash<TabulationHash<num>> or BasicTreeKLMinhash<PairWiseHash<num>> call the (final) hash functions directly,
+ * so that the compiler can inline them.
+ */
+template <class H = Hash<num>>
+class BasicTreeKLMinhash : public BasicKLMinhash<BasicTreeKLMinhash<H>, H>
 {
 private:
-    /**
-     * U: the maximum size of the set (aka the universe size)
-     */
-    num U;
-
-    /**
-     * k: number of hash functions and buffers in the signature
-     */
-    int k;
+    typedef BasicKLMinhash<BasicTreeKLMinhash<H>, H> Base;
+    friend Base;
 
     /**
-     * l: number of hash values for each buffer
+     * stride: l rounded up to a multiple of 16 (64 bytes), i.e. the distance between two consecutive buffers
      */
-    int l;
+    int stride;
 
     /**
      * buffers: the signature of the set.
-     * It represents a sequence of k buffers, each containing l elements.
+     * It represents a sequence of k buffers, each containing l elements sorted in increasing order:
+     * the i-th buffer starts at buffers[i * stride].
      */
-    multiset<num> **buffers;
+    num *buffers;
 
     /**
-     * delta: the maximum value in each buffer
+     * dirtyRows: bitmask of the rows whose minimum (i.e. whose entry of the signature) may have changed since the last clearDirtyRows
      */
-    num *delta;
+    uint64_t *dirtyRows;
 
+public:
     /**
-     * hashes: array of k hash functions
+     * KIND: the kind of the records of the sketch (see Serialization.cpp)
      */
-    Hash<num> **hashes;
+    static const uint32_t KIND = serialization::TREE;
 
-    bool doFreeHashes = true;
+    BasicTreeKLMinhash() {}
 
-    /**
-     * signature: the minhash signature.
-     */
-    num *signature;
-
-    /**
-     * explicitSet: if true, the set is explicitly stored.
-     * TODO: it will be deleted in the future
-     */
-    bool explicitSet;
+    BasicTreeKLMinhash(int k, int l, num U, bool explicitSet = true)
+    {
+        new (this) BasicTreeKLMinhash(k, l, U, explicitSet, randomSeed());
+    }
 
     /**
-     * elements: the set
-     * TODO: it will be deleted in the future
+     * Constructor
+     * the k hash functions are derived from the seed, so that two sketches built with the same seed
+     * (even by different processes) use the same hash functions and their signatures can be compared.
      */
-    std::unordered_set<num> elements;
-
-public:
-    TreeKLMinhash() : k(1), l(1), U(1) {}
-
-    TreeKLMinhash(int k, int l, num U, bool explicitSet = true)
+    BasicTreeKLMinhash(int k, int l, num U, bool explicitSet, uint64_t seed)
     {
         // PairWiseHash<num> *hashes = new PairWiseHash<num>[k];
 
-        // PairWiseHash<num> **hashes = (PairWiseHash<num> **)malloc(k * sizeof(PairWiseHash<num> *));
-        TabulationHash<num> **hashes = (TabulationHash<num> **)malloc(k * sizeof(TabulationHash<num> *));
+        // the type-erased sketch uses tabulation hash functions, stored in its own bank
+        if constexpr (std::is_abstract<H>::value)
+        {
+            new (this) BasicTreeKLMinhash(k, l, U, new HashBank(k, seed), explicitSet);
+            this->doFreeBank = true;
+            return;
+        }
+
+        SplitMix64 rng(seed);
+        H **hashes = (H **)malloc(k * sizeof(H *));
         for (int i = 0; i < k; i++)
             // hashes[i] = new PairWiseHash<num>(U);
-            hashes[i] = new TabulationHash<num>();
+            hashes[i] = newHash<H, TabulationHash<num>>(UINT32_MAX, rng);
 
-        new (this) TreeKLMinhash(k, l, U, (Hash<num> **)hashes, explicitSet, true);
+        new (this) BasicTreeKLMinhash(k, l, U, hashes, explicitSet, true);
+        this->seed = seed;
+        this->seeded = true;
     }
 
     /**
      * Constructor
+     * the sketch uses the first k hash functions of the bank, that can be shared with other sketches
      */
-    TreeKLMinhash(int k, int l, num U, Hash<num> **hashes, bool explicitSet = true, bool doFreeHashes = false)
-        : k(k), l(l), U(U), hashes(hashes), explicitSet(explicitSet), doFreeHashes(doFreeHashes)
+    BasicTreeKLMinhash(int k, int l, num U, HashBank *bank, bool explicitSet = true)
     {
-        // this->hashes = new std::pair<num, num>[k];
-        this->buffers = (multiset<num> **)malloc(k * sizeof(multiset<num> *));
-        this->delta = (num *)malloc(k * sizeof(num));
+        new (this) BasicTreeKLMinhash(k, l, U, (H **)nullptr, explicitSet, false);
+        this->bank = bank;
+        this->doFreeBank = false;
+    }
 
-        this->signature = (num *)malloc(this->k * sizeof(num));
+    /**
+     * Constructor
+     */
+    BasicTreeKLMinhash(int k, int l, num U, H **hashes, bool explicitSet = true, bool doFreeHashes = false)
+        : Base(k, l, U, hashes, explicitSet, doFreeHashes)
+    {
+        this->allocate();
 
         for (int i = 0; i < k; i++)
         {
-            // this->buffers[i] = multiset<num>();
-            this->buffers[i] = new multiset<num>();
             this->delta[i] = NUM_MAX;
 
             for (int j = 0; j < l; j++)
-                this->buffers[i]->insert(NUM_MAX);
+                this->buffers[i * this->stride + j] = NUM_MAX;
 
             this->signature[i] = NUM_MAX;
         }
     }
 
-    ~TreeKLMinhash()
+    /**
+     * Allocates the arena and sets the pointers to its sections.
+     * delta, hashValues and signature have padded(k) entries (bank->hashAll scans them with vector loads),
+     * and the padding of delta is set to zero, so that the padding rows are never selected.
+     */
+    void allocate()
     {
-        for (int i = 0; i < k; i++)
-            delete this->buffers[i];
-        delete[] this->buffers;
-        delete[] this->delta;
-        delete[] this->signature;
-
-        if (doFreeHashes)
-        {
-            for (int i = 0; i < k; i++)
-                delete this->hashes[i];
-
-            delete[] this->hashes;
-        }
+        int padded = HashBank::padded(this->k);
+        int maskSize = ((2 * padded / 64 * sizeof(uint64_t) / sizeof(num)) + 15) & ~15;
+        this->stride = (this->l + 15) & ~15;
+
+        size_t size = 3 * padded + maskSize + (size_t)this->k * this->stride;
+        this->arena = (num *)aligned_alloc(64, size * sizeof(num));
+        memset(this->arena, 0, (3 * padded + maskSize) * sizeof(num));
+
+        this->delta = this->arena;
+        this->hashValues = this->arena + padded;
+        this->signature = this->arena + 2 * padded;
+        this->rowMask = (uint64_t *)(this->arena + 3 * padded);
+        this->dirtyRows = this->rowMask + padded / 64;
+        this->buffers = this->arena + 3 * padded + maskSize;
     }
 
     /**
-     * Computes the hash of x using the i-th hash function
+     * Inserts the hash value h (with h <= delta[i]) into the i-th buffer.
      */
-    num hash(num x, int i)
+    void insertAt(int i, num h)
     {
-        return (*this->hashes[i])(x);
+        // the maximum (the last entry) is dropped, and the entries after h are shifted to the right
+        num *buffer = this->buffers + (size_t)i * this->stride;
+        int j = upperBound(buffer, this->l - 1, h);
+        memmove(buffer + j + 1, buffer + j, (this->l - 1 - j) * sizeof(num));
+        buffer[j] = h;
+        if (j == 0)
+            this->markDirty(i);
+
+        num max = buffer[this->l - 1];
+        if (max < this->delta[i])
+            this->delta[i] = max;
     }
 
-    void insert(num x)
+    /**
+     * Returns the number of entries of the sorted array a (of size n) that are <= h.
+     * The binary search is branchless: the number of steps only depends on n, and the comparisons compile to conditional moves.
+     */
+    static int upperBound(const num *a, int n, num h)
     {
-        this->insert(x, true);
+        if (n == 0)
+            return 0;
+
+        const num *base = a;
+        while (n > 1)
+        {
+            int half = n / 2;
+            base = base[half] <= h ? base + half : base;
+            n -= half;
+        }
+        return (base - a) + (*base <= h);
     }
 
     /**
-     * Inserts x into the sketch.
-     * If insertIntoSet is true (default) and isExplicitSet flag is true, x is also explicitaly stored.
+     * Removes the hash value h (with h <= delta[i]) from the i-th buffer, if present.
+     * Returns true if the buffer gets empty, i.e. if a fault occurs (the caller has to recover the sketch).
      */
-    void insert(num x, bool insertIntoSet)
+    bool removeAt(int i, num h)
     {
-        if (this->explicitSet && insertIntoSet)
-            this->elements.insert(x);
-
-        for (int i = 0; i < this->k; i++)
+        // h is at position j - 1, if present
+        num *buffer = this->buffers + (size_t)i * this->stride;
+        int j = upperBound(buffer, this->l, h);
+        if (j > 0 && buffer[j - 1] == h)
         {
-            num h = hash(x, i);
-            // num h = x;
-            if (h > this->delta[i])
-                continue;
+            memmove(buffer + j - 1, buffer + j, (this->l - j) * sizeof(num));
+            buffer[this->l - 1] = NUM_MAX;
+            if (j == 1)
+                this->markDirty(i);
 
-            auto current_max = this->buffers[i]->rbegin();
-            this->buffers[i]->erase(next(current_max).base());
-            this->buffers[i]->insert(h);
+            if (buffer[0] == NUM_MAX)
+                return true;
+        }
 
-            this->signature[i] = *this->buffers[i]->begin();
+        return false;
+    }
 
-            num max = *this->buffers[i]->rbegin();
-            if (max < this->delta[i])
-                this->delta[i] = max;
-        }
+    /**
+     * Returns true if the i-th buffer is empty
+     */
+    bool isEmpty(int i)
+    {
+        return this->buffers[(size_t)i * this->stride] == NUM_MAX;
     }
 
     /**
-     * Removes x from the sketch.
-     * If a fault occurs:
-     * - the method returns trueTreeKLMinhash *A = new TreeKLMinhash(k, l, U, hashes, false);
-     * - the buffer is reset
-     * - if the explicitSet flag is true, all the elements are reinserted
-     * The method returns false otherwise
+     * Returns the minimum of the i-th row, i.e. the i-th entry of the signature
      */
-    bool remove(num x)
+    num getMin(int i)
     {
-        if (this->explicitSet)
-            this->elements.erase(x);
+        return this->buffers[(size_t)i * this->stride];
+    }
 
-        for (int i = 0; i < this->k; i++)
-        {
-            num h = hash(x, i);
-            // num h = x;
-            if (h > this->delta[i])
-                continue;
-
-            auto element = this->buffers[i]->find(h);
-            if (element != this->buffers[i]->end())
-            {
-                this->buffers[i]->erase(element);
-                this->buffers[i]->insert(NUM_MAX);
-
-                if (*this->buffers[i]->begin() == NUM_MAX)
-                {
-                    this->resetBuffer();
-                    if (this->explicitSet)
-                        this->fault();
-
-                    return true;
-                }
-
-                this->signature[i] = *this->buffers[i]->begin();
-            }
-        }
+    /**
+     * Marks the i-th entry of the signature as changed (see getDirtyRows)
+     */
+    void markDirty(int i)
+    {
+        this->dirtyRows[i / 64] |= 1ull << (i % 64);
+    }
 
-        return false;
+    /**
+     * Returns the bitmask (padded(k) / 64 words) of the rows whose minimum may have changed since the last call of clearDirtyRows:
+     * every update that changes the first entry of a buffer (an insertion of a new minimum, the removal of the minimum, a reset
+     * during a fault, a merge) sets the bit of its row, so that e.g. an index of the signatures (see DynamicLSH) only reads those rows.
+     */
+    const uint64_t *getDirtyRows()
+    {
+        return this->dirtyRows;
+    }
+
+    void clearDirtyRows()
+    {
+        memset(this->dirtyRows, 0, HashBank::padded(this->k) / 64 * sizeof(uint64_t));
     }
 
     /**
-     * Reinserts all the elements in the sketch.
+     * Copies the values of the i-th buffer, in increasing order, into values (l entries). Returns their number.
      */
-    void fault()
+    int rowValues(int i, num *values)
     {
-        auto itr = this->elements.begin();
-        for (; itr != this->elements.end(); ++itr)
-            this->insert(*itr, false);
+        const num *buffer = this->buffers + (size_t)i * this->stride;
+        int n = 0;
+        while (n < this->l && buffer[n] != NUM_MAX)
+            n++;
+        memcpy(values, buffer, n * sizeof(num));
+        return n;
     }
 
     /**
-     * Returns the k-minhash signature
+     * Replaces the i-th buffer with the n values (n <= l, sorted in increasing order). delta is set by the caller.
      */
-    num *getSignature()
+    void setRow(int i, const num *values, int n)
     {
-        // for (int i = 0; i < this->k; i++)
-        //     this->signature[i] = *this->buffers[i]->begin();
-        return this->signature;
+        num *buffer = this->buffers + (size_t)i * this->stride;
+        if (buffer[0] != (n > 0 ? values[0] : NUM_MAX))
+            this->markDirty(i);
+        memcpy(buffer, values, n * sizeof(num));
+        for (int j = n; j < this->l; j++)
+            buffer[j] = NUM_MAX;
     }
 
     /**
-     * Static method that given two sketches (TreeKLMinhash) A & B returns the estimation of their jaccard similarity.
+     * Writes the i-th row in a record: its sorted buffer (l values)
      */
-    static double similarity(TreeKLMinhash *A, TreeKLMinhash *B)
+    void saveRow(SketchRecordWriter &writer, int i)
     {
-        num *sigA = A->getSignature();
-        num *sigB = B->getSignature();
+        writer.write(this->buffers + (size_t)i * this->stride, this->l);
+    }
 
-        int k = A->k;
-        double c = .0;
-        for (int i = 0; i < k; i++)
-            c += sigA[i] == sigB[i];
-        return c / static_cast<double>(k);
+    /**
+     * Reads the i-th row from a record (see saveRow), whose delta has already been set.
+     * Returns false if the row is malformed: the buffer must be sorted, and a full buffer must end with delta.
+     */
+    bool loadRow(SketchView &view, int i)
+    {
+        num *buffer = this->buffers + (size_t)i * this->stride;
+        for (int j = 0; j < this->l; j++)
+            buffer[j] = view.row(i, j);
+        this->markDirty(i);
+
+        for (int j = 1; j < this->l; j++)
+            if (buffer[j] < buffer[j - 1])
+                return false;
+        return buffer[this->l - 1] == NUM_MAX || buffer[this->l - 1] == this->delta[i];
     }
 
     /**
-     * Resets the buffer to default values.
+     * Resets the i-th row to default values.
      */
-    void resetBuffer()
+    void resetRow(int i)
     {
-        for (int i = 0; i < this->k; i++)
-        {
-            this->delta[i] = NUM_MAX;
-            this->buffers[i]->clear();
-            for (int j = 0; j < this->l; j++)
-                this->buffers[i]->insert(NUM_MAX);
+        this->delta[i] = NUM_MAX;
+        for (int j = 0; j < this->l; j++)
+            this->buffers[(size_t)i * this->stride + j] = NUM_MAX;
 
-            this->signature[i] = NUM_MAX;
-        }
+        this->signature[i] = NUM_MAX;
+        this->markDirty(i);
     }
 
     /**
@@ -274,24 +323,17 @@ public:
         else
             cout << "[" << current_max << "]\t";
 
-        for (auto itr = this->buffers[i]->begin(); itr != this->buffers[i]->end(); itr++)
+        for (int j = 0; j < this->l; j++)
         {
-            if (*itr == NUM_MAX)
+            if (this->buffers[i * this->stride + j] == NUM_MAX)
                 cout << start << "∞" << end << " ";
             else
-                cout << start << *itr << end << " ";
+                cout << start << this->buffers[i * this->stride + j] << end << " ";
         }
         cout << endl;
     }
-
-    /**
-     * Prints the signature matrix.
-     */
-    void print()
-    {
-        for (int i = 0; i < this->k; i++)
-            this->printRow(i);
-    }
 };
 
+typedef BasicTreeKLMinhash<Hash<num>> TreeKLMinhash;
+
 #endif
@@ -8,11 +8,88 @@ typedef std::mt19937 RNG; // the Mersenne Twister with a popular choice of param
 
 using namespace std;
 
+/**
+ * SplitMix64 pseudo-random generator, used to derive hash functions from a 64-bit seed.
+ * Its state is a single word, so that creating a generator is free, and the n-th output only depends on
+ * the seed and on n (see at), so that the same seed yields the same hash functions in every process.
+ */
+class SplitMix64
+{
+private:
+    uint64_t state;
+
+public:
+    typedef uint64_t result_type;
+
+    static constexpr uint64_t GAMMA = 0x9e3779b97f4a7c15ull;
+
+    SplitMix64(uint64_t seed) : state(seed) {}
+
+    static constexpr uint64_t min() { return 0; }
+    static constexpr uint64_t max() { return UINT64_MAX; }
+
+    /**
+     * Returns the n-th output (starting from 0) of the generator with the given seed
+     */
+    static uint64_t at(uint64_t seed, uint64_t n)
+    {
+        uint64_t z = seed + (n + 1) * GAMMA;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t operator()()
+    {
+        uint64_t z = at(this->state, 0);
+        this->state += GAMMA;
+        return z;
+    }
+
+    /**
+     * Returns the next 32 random bits
+     */
+    uint32_t next32()
+    {
+        return (uint32_t)((*this)() >> 32);
+    }
+
+    /**
+     * Returns a value in [0, n]
+     */
+    uint32_t upTo(uint32_t n)
+    {
+        return (uint32_t)(((uint64_t)this->next32() * ((uint64_t)n + 1)) >> 32);
+    }
+};
+
+/**
+ * Returns a random seed, obtained from the hardware
+ */
+uint64_t randomSeed()
+{
+    std::random_device rd;
+    return ((uint64_t)rd() << 32) | rd();
+}
+
+/**
+ * Returns the generator used by the hash functions built without an explicit generator.
+ * It is seeded from the hardware only once per thread.
+ */
+SplitMix64 &defaultRNG()
+{
+    thread_local SplitMix64 rng(randomSeed());
+    return rng;
+}
+
 template <class T>
 class Hash
 {
 public:
     virtual T operator()(T x) = 0;
+
+    // the type-erased sketches delete their functions through Hash<T> *
+    virtual ~Hash() {}
 };
 
 template <class T>
@@ -66,21 +143,27 @@ public:
  * tempo: 4 xor + 4 shift
  */
 template <>
-class TabulationHash<uint32_t> : public Hash<uint32_t>
+class TabulationHash<uint32_t> final : public Hash<uint32_t>
 {
 private:
     uint32_t table[8][16];
     uint32_t U;
 
 public:
-    TabulationHash(uint32_t U) : U(U)
+    /**
+     * Constructor
+     * the 128 entries of the table (range [0, U]) are the next draws of rng, in row-major order
+     */
+    TabulationHash(uint32_t U, SplitMix64 &rng) : U(U)
     {
-        std::random_device rd; // Obtain a random seed from the hardware
-        RNG rng(rd());
-        std::uniform_int_distribution<uint32_t> uint_dist(0, U); // by default range [0, MAX]
         for (int i = 0; i < 8; i++)
             for (int j = 0; j < 16; j++)
-                table[i][j] = uint_dist(rng);
+                table[i][j] = rng.upTo(U);
+    }
+
+    TabulationHash(uint32_t U)
+    {
+        new (this) TabulationHash(U, defaultRNG());
     }
 
     TabulationHash() {
@@ -96,23 +179,33 @@ public:
             res ^= table[i][(uint8_t)((x >> 4 * i) & 0b1111)]; // added the end with binary 00001111 to slip the 4 least significant bits
         return res;
     }
+
+    /**
+     * Returns the entry T[i][j] of the table, i.e. the value xored for the i-th nibble when it is equal to j
+     */
+    uint32_t entry(int i, int j) const
+    {
+        return table[i][j];
+    }
 };
 
 template <>
-class TabulationHash<uint64_t> : public Hash<uint64_t>
+class TabulationHash<uint64_t> final : public Hash<uint64_t>
 {
 private:
     uint64_t table[8][256];
 
 public:
-    TabulationHash()
+    TabulationHash(SplitMix64 &rng)
     {
-        std::random_device rd;                             // Obtain a random seed from the hardware
-        RNG rng(rd());                                     // Create a generator instance with the seed
-        std::uniform_int_distribution<uint32_t> uint_dist; // by default range [0, MAX]
         for (int i = 0; i < 8; i++)
             for (int j = 0; j < 256; j++)
-                table[i][j] = ((uint64_t)uint_dist(rng) << 32) | uint_dist(rng);
+                table[i][j] = rng();
+    }
+
+    TabulationHash()
+    {
+        new (this) TabulationHash(defaultRNG());
     }
 
     uint64_t operator()(uint64_t x)
@@ -130,7 +223,7 @@ class PairWiseHash : public Hash<T>
 };
 
 template <>
-class PairWiseHash<uint32_t> : public Hash<uint32_t>
+class PairWiseHash<uint32_t> final : public Hash<uint32_t>
 {
 private:
     uint64_t a;
@@ -144,16 +237,21 @@ public:
         new (this) PairWiseHash(UINT32_MAX);
     }
 
-    PairWiseHash(uint32_t n) : n(n)
+    /**
+     * Constructor
+     * a and b are the next two draws of rng, in the range [0, n - 1]
+     */
+    PairWiseHash(uint32_t n, SplitMix64 &rng) : n(n)
     {
-        // RNG rng(1);
-        std::random_device rd;                                         // Obtain a random seed from the hardware
-        RNG rng(rd());                                                 // Create a generator instance with the seed
-        std::uniform_int_distribution<uint32_t> uint_dist_n(0, n - 1); //  range [0, n]
-        this->a = uint_dist_n(rng);
+        this->a = rng.upTo(n - 1);
         if (!this->a)
             this->a++; // set a as non-zero value
-        this->b = uint_dist_n(rng);
+        this->b = rng.upTo(n - 1);
+    }
+
+    PairWiseHash(uint32_t n)
+    {
+        new (this) PairWiseHash(n, defaultRNG());
     }
 
     ~PairWiseHash() {}
@@ -171,7 +269,7 @@ class IdentityHash : public Hash<T>
 };
 
 template <>
-class IdentityHash<uint32_t> : public Hash<uint32_t>
+class IdentityHash<uint32_t> final : public Hash<uint32_t>
 {
 public:
     uint32_t operator()(uint32_t x)
@@ -180,4 +278,19 @@ public:
     }
 };
 
+/**
+ * Creates a new hash function of the family H, passing args to its constructor.
+ * If H is the abstract (type-erased) Hash<T>, a function of the family D is created instead.
+ *
+ * The concrete families are final, so a sketch templated on one of them calls operator() without virtual dispatch.
+ */
+template <class H, class D, class... Args>
+H *newHash(Args &&...args)
+{
+    if constexpr (std::is_abstract<H>::value)
+        return new D(std::forward<Args>(args)...);
+    else
+        return new H(std::forward<Args>(args)...);
+}
+
 #endif
@@ -1,11 +1,25 @@
 #include "../TreeKLMinhash.cpp"
 #include "../ArrayKLMinhash.cpp"
+#include "../ParallelKLMinhash.cpp"
+#include "../ParallelBuild.cpp"
+#include "../OPHKLMinhash.cpp"
+#include "../BottomKMinhash.cpp"
+#include "../BBitSignature.cpp"
+#include "../Similarity.cpp"
+#include "../AllPairs.cpp"
+#include "../DynamicLSH.cpp"
 #include "../DSS.cpp"
 #include "../DSSProactive.cpp"
 #include "../LSH.cpp"
 #include "../BitArray.cpp"
 #include <algorithm>
 #include <chrono>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 using namespace std::chrono;
 using namespace std;
 
@@ -104,6 +118,819 @@ void singleSetImplicit(int k, int l, int N, bool tree_buffer = true)
     delete[] sample;
 }
 
+/**
+ * This experiment evaluates the performance of the OPHKLMinhash sketch (see singleSetImplicit).
+ * The sketch is created with k bins of size l.
+ * The experiment first inserts N elements in the sketch and then removes them, measuring the time.
+ * @param k number of bins
+ * @param l size of the buffers
+ * @param N 2*N is the number of operations
+ */
+void singleSetImplicitOPH(int k, int l, int N)
+{
+    // counter of faults
+    int n_fault = 0;
+
+    // create a new OPHKLMinhash sketch
+    OPHKLMinhash *S = new OPHKLMinhash(k, l, UINT32_MAX, false);
+
+    // generate a random sample
+    uint32_t *sample = generate_random_sample(N);
+
+    // start the timer
+    auto start = high_resolution_clock::now();
+
+    // insert all elements in the sketch
+    for (int i = 0; i < N; i++)
+        S->insert(sample[i]);
+
+    // remove all elements from the sketch
+    for (int i = 0; i < N; i++)
+    {
+        int doFault = S->remove(sample[i]);
+        if (doFault)
+        {
+            n_fault++;
+
+            // recovery query
+            for (int j = i + 1; j < N; j++)
+                S->insert(sample[j]);
+        }
+    }
+
+    // stop the timer
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+    float t = (float)duration.count() / 1000000.0;
+
+    // print the results
+    printf("OPH-DMH, %d, %d, %u, %d, %f\n", k, l, 2 * N, n_fault, t);
+
+    delete S;
+    delete[] sample;
+}
+
+/**
+ * This experiment evaluates the performance of the BottomKMinhash sketch (see singleSetImplicit).
+ * The sketch is created with a buffer of size k + l.
+ * The experiment first inserts N elements in the sketch and then removes them, measuring the time.
+ * @param k size of the signature
+ * @param l number of extra values of the buffer
+ * @param N 2*N is the number of operations
+ */
+void singleSetImplicitBottomK(int k, int l, int N)
+{
+    // counter of faults
+    int n_fault = 0;
+
+    // create a new BottomKMinhash sketch
+    BottomKMinhash *S = new BottomKMinhash(k, l, UINT32_MAX, false);
+
+    // generate a random sample
+    uint32_t *sample = generate_random_sample(N);
+
+    // start the timer
+    auto start = high_resolution_clock::now();
+
+    // insert all elements in the sketch
+    for (int i = 0; i < N; i++)
+        S->insert(sample[i]);
+
+    // remove all elements from the sketch
+    for (int i = 0; i < N; i++)
+    {
+        int doFault = S->remove(sample[i]);
+        if (doFault)
+        {
+            n_fault++;
+
+            // recovery query
+            for (int j = i + 1; j < N; j++)
+                S->insert(sample[j]);
+        }
+    }
+
+    // stop the timer
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+    float t = (float)duration.count() / 1000000.0;
+
+    // print the results
+    printf("bottomk-DMH, %d, %d, %u, %d, %f\n", k, l, 2 * N, n_fault, t);
+
+    delete S;
+    delete[] sample;
+}
+
+/**
+ * This experiment compares the two recovery modes of the BufferKLMinhash sketch with an explicit set:
+ * the sketch is reset (and rebuilt) entirely after each fault, or only the rows that get empty are reset and rebuilt.
+ * The experiment first inserts N elements in the sketch and then removes them, measuring the time.
+ * @param k number of hash functions
+ * @param l size of the buffers
+ * @param N 2*N is the number of operations
+ * @param rowRecovery if true, the sketch recovers only the rows that get empty
+ * @param tree_buffer if true, the sketch is created with a tree buffer, otherwise an array buffer is used
+ */
+void singleSetExplicitRecovery(int k, int l, int N, bool rowRecovery, bool tree_buffer = true)
+{
+    // counter of faults (and of the rows that got empty)
+    int n_fault = 0;
+    long long n_rows = 0;
+
+    uint32_t *sample = generate_random_sample(N);
+
+    auto run = [&](auto *S)
+    {
+        S->setRowRecovery(rowRecovery);
+        auto start = high_resolution_clock::now();
+
+        for (int i = 0; i < N; i++)
+            S->insert(sample[i]);
+
+        for (int i = 0; i < N; i++)
+        {
+            if (S->remove(sample[i]))
+            {
+                n_fault++;
+                n_rows += rowRecovery ? S->getFaultyRows().size() : k;
+            }
+        }
+
+        auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+        return (float)duration.count() / 1000000.0;
+    };
+
+    float t;
+    if (tree_buffer)
+    {
+        TreeKLMinhash *S = new TreeKLMinhash(k, l, UINT32_MAX, true);
+        t = run(S);
+        delete S;
+    }
+    else
+    {
+        ArrayKLMinhash *S = new ArrayKLMinhash(k, l, UINT32_MAX, true);
+        t = run(S);
+        delete S;
+    }
+
+    printf("%s-DMH-%s, %d, %d, %u, %d, %lld, %f\n", tree_buffer ? "tree" : "array", rowRecovery ? "row-recovery" : "full-recovery", k, l, 2 * N, n_fault, n_rows, t);
+
+    delete[] sample;
+}
+
+/**
+ * This experiment measures the latency of the updates of the BufferKLMinhash sketch with an explicit set,
+ * with synchronous recovery (step = 0) or with incremental recovery (step elements reinserted at each update).
+ * The experiment first inserts N elements in the sketch and then removes them, measuring the time of every operation.
+ * It prints the percentiles 50, 99 and 99.9 and the maximum of the latency (in nanoseconds),
+ * and the number of operations served while the sketch was recovering.
+ * @param k number of hash functions
+ * @param l size of the buffers
+ * @param N 2*N is the number of operations
+ * @param step the number of elements reinserted at each update (0 for synchronous recovery)
+ * @param tree_buffer if true, the sketch is created with a tree buffer, otherwise an array buffer is used
+ */
+void singleSetExplicitLatency(int k, int l, int N, int step, bool tree_buffer = true)
+{
+    int n_fault = 0;
+    int n_recovering = 0;
+    uint32_t *sample = generate_random_sample(N);
+    vector<long long> latency(2 * N);
+
+    auto run = [&](auto *S)
+    {
+        S->setIncrementalRecovery(step);
+
+        for (int i = 0; i < N; i++)
+        {
+            auto start = high_resolution_clock::now();
+            S->insert(sample[i]);
+            latency[i] = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count();
+        }
+
+        for (int i = 0; i < N; i++)
+        {
+            auto start = high_resolution_clock::now();
+            n_fault += S->remove(sample[i]);
+            latency[N + i] = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count();
+            n_recovering += S->isRecovering();
+        }
+    };
+
+    if (tree_buffer)
+    {
+        TreeKLMinhash *S = new TreeKLMinhash(k, l, UINT32_MAX, true);
+        run(S);
+        delete S;
+    }
+    else
+    {
+        ArrayKLMinhash *S = new ArrayKLMinhash(k, l, UINT32_MAX, true);
+        run(S);
+        delete S;
+    }
+
+    sort(latency.begin(), latency.end());
+    long long p50 = latency[latency.size() / 2];
+    long long p99 = latency[latency.size() * 99 / 100];
+    long long p999 = latency[latency.size() * 999 / 1000];
+    long long max = latency.back();
+
+    printf("%s-DMH-latency, %d, %d, %u, %d, %d, %d, %lld, %lld, %lld, %lld\n", tree_buffer ? "tree" : "array", k, l, 2 * N, step, n_fault, n_recovering, p50, p99, p999, max);
+
+    delete[] sample;
+}
+
+/**
+ * This experiment evaluates a store of the explicit set (see RecoveryStore.cpp):
+ * it inserts N distinct random elements of [0, range) and then erases them, measuring the memory and the throughput.
+ * It prints the bytes per element (after the insertions), and the millions of insertions and of deletions per second.
+ * @param store the store (it is deleted at the end)
+ * @param name the name of the store, printed in the results
+ * @param N the number of elements
+ * @param range the elements are in [0, range) (range >= N)
+ */
+void testRecoveryStore(RecoveryStore *store, const char *name, int N, uint32_t range)
+{
+    // N distinct elements of [0, range)
+    unordered_set<uint32_t> values(N);
+    std::mt19937 rng(N);
+    std::uniform_int_distribution<uint32_t> dist(0, range - 1);
+    vector<uint32_t> sample;
+    while ((int)sample.size() < N)
+    {
+        uint32_t x = dist(rng);
+        if (values.insert(x).second)
+            sample.push_back(x);
+    }
+
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < N; i++)
+        store->insert(sample[i]);
+    double t_insert = duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000000.0;
+
+    double bytes = (double)store->bytes() / N;
+
+    start = high_resolution_clock::now();
+    for (int i = 0; i < N; i++)
+        store->erase(sample[i]);
+    double t_erase = duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000000.0;
+
+    printf("%s, %d, %u, %f, %f, %f\n", name, N, range, bytes, N / t_insert / 1e6, N / t_erase / 1e6);
+
+    delete store;
+}
+
+/**
+ * This experiment compares the construction of the BufferKLMinhash sketch of a set of N random elements
+ * by a serial loop of insertions and by parallelBuild with n_threads threads (partition and merge).
+ * It prints the two times, and the number of rows in which the two signatures differ (always 0).
+ * @param k number of hash functions
+ * @param l size of the buffers
+ * @param N the number of elements
+ * @param n_threads the number of threads
+ * @param tree_buffer if true, the sketch is created with a tree buffer, otherwise an array buffer is used
+ */
+void testParallelBuild(int k, int l, int N, int n_threads, bool tree_buffer = true)
+{
+    uint32_t *sample = generate_random_sample(N);
+    uint64_t seed = randomSeed();
+    int diff = 0;
+
+    auto run = [&](auto *serial, auto *(*build)(const num *, size_t, int, int, num, uint64_t, int))
+    {
+        auto start = high_resolution_clock::now();
+        for (int i = 0; i < N; i++)
+            serial->insert(sample[i]);
+        float t_serial = duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000000.0;
+
+        start = high_resolution_clock::now();
+        auto *parallel = build(sample, N, k, l, UINT32_MAX, seed, n_threads);
+        float t_parallel = duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000000.0;
+
+        num *sigA = serial->getSignature();
+        num *sigB = parallel->getSignature();
+        for (int i = 0; i < k; i++)
+            diff += sigA[i] != sigB[i];
+
+        delete serial;
+        delete parallel;
+        return make_pair(t_serial, t_parallel);
+    };
+
+    pair<float, float> t;
+    if (tree_buffer)
+        t = run(new TreeKLMinhash(k, l, UINT32_MAX, false, seed), &parallelBuild<TreeKLMinhash>);
+    else
+        t = run(new ArrayKLMinhash(k, l, UINT32_MAX, false, seed), &parallelBuild<ArrayKLMinhash>);
+
+    printf("%s-DMH-build, %d, %d, %d, %d, %f, %f, %d\n", tree_buffer ? "tree" : "array", k, l, N, n_threads, t.first, t.second, diff);
+
+    delete[] sample;
+}
+
+/**
+ * This experiment evaluates the binary format of the sketches (see Serialization.cpp) on a store of n sketches.
+ * Every sketch summarizes setSize random elements, and all the sketches share the same seed. It prints:
+ * the size of the file (MB), the time to write it (s), the time to open it with a MappedSketchFile (ms),
+ * the millions of similarity queries per second on the mapping (random pairs of views),
+ * and the time to load (with load(istream &)) the first 10^4 sketches (s).
+ * @param n the number of sketches
+ * @param k number of hash functions
+ * @param l size of the buffers
+ * @param setSize the number of elements of each set
+ * @param fileName the file of the store (it is overwritten)
+ */
+void testSerialization(int n, int k, int l, int setSize, const char *fileName)
+{
+    std::mt19937 rng(n);
+
+    // a single sketch is reset and rebuilt for every set
+    TreeKLMinhash *S = new TreeKLMinhash(k, l, UINT32_MAX, false);
+    auto start = high_resolution_clock::now();
+    {
+        ofstream out(fileName, ios::binary);
+        SketchFileWriter writer(out);
+        for (int i = 0; i < n; i++)
+        {
+            S->resetBuffer();
+            for (int j = 0; j < setSize; j++)
+                S->insert(rng());
+            writer.add(S);
+        }
+        writer.finish();
+    }
+    double t_write = duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000000.0;
+    delete S;
+
+    start = high_resolution_clock::now();
+    MappedSketchFile *file = new MappedSketchFile(fileName);
+    double t_open = duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000.0;
+    if (!file->isOpen())
+    {
+        printf("cannot open %s\n", fileName);
+        delete file;
+        return;
+    }
+
+    int n_query = 1000000;
+    double sum = 0;
+    start = high_resolution_clock::now();
+    for (int q = 0; q < n_query; q++)
+        sum += SketchView::similarity(file->get(rng() % n), file->get(rng() % n));
+    double t_query = duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000000.0;
+    if (file->get(n).valid())
+        printf("get(%d) of a file of %d sketches returned a valid view\n", n, n);
+
+    int n_load = min(n, 10000);
+    start = high_resolution_clock::now();
+    {
+        ifstream in(fileName, ios::binary);
+        for (int i = 0; i < n_load; i++)
+            delete TreeKLMinhash::load(in);
+    }
+    double t_load = duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000000.0;
+
+    struct stat st;
+    stat(fileName, &st);
+    printf("serialization, %d, %d, %d, %d, %f, %f, %f, %f, %f, (%f)\n", n, k, l, setSize, st.st_size / 1e6, t_write, t_open, n_query / t_query / 1e6, t_load, sum / n_query);
+
+    delete file;
+}
+
+/**
+ * Checks that load rejects malformed records: a forged header (k out of range, with a size that matches it),
+ * rows inconsistent with their delta (an ArrayKLMinhash row with size > l, with a wrong minimum,
+ * or full without delta in its buffer; a TreeKLMinhash row that is not sorted), and a record of another hash family
+ * (a seeded sketch of pairwise functions loaded with tabulation functions).
+ * Prints the number of malformed records, the number of rejected ones and the number of intact records (out of 3) that load.
+ * @param k the number of hash functions
+ * @param l the size of the buffers
+ * @param setSize the number of elements of the sketches (large enough to fill the buffers)
+ */
+void testCorruptRecords(int k, int l, int setSize)
+{
+    std::mt19937 rng(k);
+    ArrayKLMinhash *A = new ArrayKLMinhash(k, l, UINT32_MAX, false);
+    TreeKLMinhash *T = new TreeKLMinhash(k, l, UINT32_MAX, false);
+    for (int j = 0; j < setSize; j++)
+    {
+        uint32_t x = rng();
+        A->insert(x);
+        T->insert(x);
+    }
+
+    vector<uint64_t> array, tree;
+    {
+        stringstream out;
+        A->save(out);
+        T->save(out);
+        readRecord(out, array);
+        readRecord(out, tree);
+    }
+    delete A;
+    delete T;
+
+    int n_corrupt = 0, n_rejected = 0, n_intact = 0;
+    auto values = [](vector<uint64_t> &data) { return (num *)((char *)data.data() + sizeof(SketchRecord)); };
+    auto check = [&](bool loaded) { n_corrupt++; n_rejected += !loaded; };
+
+    // forged headers: the size matches k, so only the bounds on k reject them
+    for (uint32_t forged : {0x7fffffffu, 0xffffffffu, 0u})
+    {
+        SketchRecord r = *(SketchRecord *)array.data();
+        r.k = forged;
+        r.size = (sizeof(SketchRecord) + ((uint64_t)2 * forged + (uint64_t)forged * (l + 2)) * sizeof(num) + 7) & ~7ull;
+        stringstream in(string((char *)&r, sizeof(r)));
+        ArrayKLMinhash *S = ArrayKLMinhash::load(in);
+        check(S != nullptr);
+        delete S;
+    }
+
+    size_t row = 2 * (size_t)k;
+    for (int c = 0; c < 3; c++)
+    {
+        vector<uint64_t> data = array;
+        num *v = values(data);
+        if (c == 0)
+            v[row + 1] = l + 1; // size > l
+        else if (c == 1)
+            v[row] += 1; // wrong minimum
+        else
+            v[0] = *max_element(v + row + 2, v + row + 2 + l) + 1; // full row without delta
+        ArrayKLMinhash *S = ArrayKLMinhash::load(SketchView(data.data()));
+        check(S != nullptr);
+        delete S;
+    }
+
+    {
+        vector<uint64_t> data = tree;
+        num *v = values(data);
+        swap(v[row], v[row + l - 1]); // not sorted
+        TreeKLMinhash *S = TreeKLMinhash::load(SketchView(data.data()));
+        check(S != nullptr);
+        delete S;
+    }
+
+    {
+        BasicTreeKLMinhash<PairWiseHash<num>> *P = new BasicTreeKLMinhash<PairWiseHash<num>>(k, l, UINT32_MAX, false, (uint64_t)k);
+        for (int j = 0; j < setSize; j++)
+            P->insert(rng());
+        vector<uint64_t> data;
+        stringstream out;
+        P->save(out);
+        SketchView view = readRecord(out, data);
+        delete P;
+
+        TreeKLMinhash *S = TreeKLMinhash::load(view);
+        check(S != nullptr);
+        delete S;
+        BasicTreeKLMinhash<TabulationHash<num>> *T = BasicTreeKLMinhash<TabulationHash<num>>::load(view);
+        check(T != nullptr);
+        delete T;
+        P = BasicTreeKLMinhash<PairWiseHash<num>>::load(view);
+        n_intact += P != nullptr;
+        delete P;
+    }
+
+    ArrayKLMinhash *intactA = ArrayKLMinhash::load(SketchView(array.data()));
+    TreeKLMinhash *intactT = TreeKLMinhash::load(SketchView(tree.data()));
+    n_intact += (intactA != nullptr) + (intactT != nullptr);
+    printf("corrupt-records, %d, %d, %d, %d, %d\n", k, l, n_corrupt, n_rejected, n_intact);
+    delete intactA;
+    delete intactT;
+}
+
+/**
+ * Runs the workload of singleSetImplicit on the sketch S: N insertions followed by N deletions,
+ * with a recovery query after each fault.
+ * @param S the sketch
+ * @param sample the N elements
+ * @param N 2*N is the number of operations
+ * @param n_fault counter of faults
+ * @return the elapsed time in seconds
+ */
+template <class S>
+float timeSingleSetImplicit(S *sketch, uint32_t *sample, int N, int &n_fault)
+{
+    auto start = high_resolution_clock::now();
+
+    for (int i = 0; i < N; i++)
+        sketch->insert(sample[i]);
+
+    for (int i = 0; i < N; i++)
+    {
+        if (sketch->remove(sample[i]))
+        {
+            n_fault++;
+
+            // recovery query
+            for (int j = i + 1; j < N; j++)
+                sketch->insert(sample[j]);
+        }
+    }
+
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+    return (float)duration.count() / 1000000.0;
+}
+
+/**
+ * Runs the workload of singleSetImplicit on the sketch S with batched updates: the N insertions and the N deletions
+ * are applied with applyBatch, in batches of the given size.
+ * After a fault the set is recovered by inserting the remaining elements, again in batches.
+ * @param S the sketch
+ * @param sample the N elements
+ * @param N 2*N is the number of operations
+ * @param batch the size of the batches
+ * @param n_fault counter of faults
+ * @return the elapsed time in seconds
+ */
+template <class S>
+float timeSingleSetImplicitBatch(S *sketch, uint32_t *sample, int N, int batch, int &n_fault)
+{
+    int8_t *inserts = new int8_t[batch];
+    int8_t *removes = new int8_t[batch];
+    for (int i = 0; i < batch; i++)
+    {
+        inserts[i] = 1;
+        removes[i] = -1;
+    }
+
+    auto start = high_resolution_clock::now();
+
+    // insert all elements in the sketch
+    for (int i = 0; i < N; i += batch)
+        sketch->applyBatch(sample + i, inserts, min(batch, N - i));
+
+    // remove all elements from the sketch
+    for (int i = 0; i < N; i += batch)
+    {
+        int end = min(i + batch, N);
+        if (sketch->applyBatch(sample + i, removes, end - i))
+        {
+            n_fault++;
+
+            // recovery query
+            for (int j = end; j < N; j += batch)
+                sketch->applyBatch(sample + j, inserts, min(batch, N - j));
+        }
+    }
+
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+
+    delete[] inserts;
+    delete[] removes;
+    return (float)duration.count() / 1000000.0;
+}
+
+/**
+ * This experiment evaluates the batched updates of the BufferKLMinhash sketch, on the workload of singleSetImplicit.
+ * @param k number of hash functions
+ * @param l size of the buffers
+ * @param N 2*N is the number of operations
+ * @param batch the size of the batches
+ * @param tree_buffer if true, the sketch is created with a tree buffer, otherwise an array buffer is used
+ */
+void singleSetImplicitBatch(int k, int l, int N, int batch, bool tree_buffer = true)
+{
+    // counter of faults
+    int n_fault = 0;
+
+    Sketch *S;
+    if (tree_buffer)
+        S = new TreeKLMinhash(k, l, UINT32_MAX, false);
+    else
+        S = new ArrayKLMinhash(k, l, UINT32_MAX, false);
+
+    // generate a random sample
+    uint32_t *sample = generate_random_sample(N);
+
+    float t = timeSingleSetImplicitBatch(S, sample, N, batch, n_fault);
+
+    // print the results
+    if (tree_buffer)
+        printf("tree-DMH-batch, %d, %d, %d, %u, %d, %f\n", k, l, batch, 2 * N, n_fault, t);
+    else
+        printf("array-DMH-batch, %d, %d, %d, %u, %d, %f\n", k, l, batch, 2 * N, n_fault, t);
+
+    delete S;
+    delete[] sample;
+}
+
+/**
+ * This experiment evaluates the scalability of the row-partitioned BufferKLMinhash sketch (ParallelKLMinhash),
+ * on the workload of singleSetImplicitBatch.
+ * It prints the number of updates per second.
+ * @param k number of hash functions
+ * @param l size of the buffers
+ * @param N 2*N is the number of operations
+ * @param batch the size of the batches
+ * @param n_threads the number of worker threads
+ * @param tree_buffer if true, the partitions are created with a tree buffer, otherwise an array buffer is used
+ */
+void singleSetImplicitParallel(int k, int l, int N, int batch, int n_threads, bool tree_buffer = true)
+{
+    // counter of faults
+    int n_fault = 0;
+
+    // generate a random sample
+    uint32_t *sample = generate_random_sample(N);
+
+    float t;
+    if (tree_buffer)
+    {
+        ParallelKLMinhash<TreeKLMinhash> *S = new ParallelKLMinhash<TreeKLMinhash>(k, l, UINT32_MAX, n_threads, false);
+        t = timeSingleSetImplicitBatch(S, sample, N, batch, n_fault);
+        delete S;
+    }
+    else
+    {
+        ParallelKLMinhash<ArrayKLMinhash> *S = new ParallelKLMinhash<ArrayKLMinhash>(k, l, UINT32_MAX, n_threads, false);
+        t = timeSingleSetImplicitBatch(S, sample, N, batch, n_fault);
+        delete S;
+    }
+
+    // print the results
+    printf("%s-DMH-parallel, %d, %d, %d, %d, %u, %d, %f, %f\n", tree_buffer ? "tree" : "array", k, l, batch, n_threads, 2 * N, n_fault, t, 2 * N / t);
+
+    delete[] sample;
+}
+
+/**
+ * Counter of the cache misses (last level cache) of the calling thread, read from the hardware counters through perf_event_open.
+ * If the counters are not available (e.g. not on Linux, or in a container without perf events) stop returns -1.
+ */
+class CacheMissCounter
+{
+private:
+    int fd = -1;
+
+public:
+    CacheMissCounter()
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        this->fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~CacheMissCounter()
+    {
+#ifdef __linux__
+        if (this->fd != -1)
+            close(this->fd);
+#endif
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        if (this->fd != -1)
+        {
+            ioctl(this->fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(this->fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    /**
+     * Returns the number of cache misses since start, or -1 if the counter is not available
+     */
+    long long stop()
+    {
+        long long count = -1;
+#ifdef __linux__
+        if (this->fd != -1)
+        {
+            ioctl(this->fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(this->fd, &count, sizeof(count)) != sizeof(count))
+                count = -1;
+        }
+#endif
+        return count;
+    }
+};
+
+/**
+ * This experiment measures the cache misses of the BufferKLMinhash sketch, on the workload of singleSetImplicit.
+ * It prints the number of cache misses per operation (-1 if the hardware counters are not available).
+ * @param k number of hash functions
+ * @param l size of the buffers
+ * @param N 2*N is the number of operations
+ * @param tree_buffer if true, the sketch is created with a tree buffer, otherwise an array buffer is used
+ */
+void singleSetImplicitCacheMisses(int k, int l, int N, bool tree_buffer = true)
+{
+    int n_fault = 0;
+    uint32_t *sample = generate_random_sample(N);
+    CacheMissCounter counter;
+
+    float t;
+    counter.start();
+    if (tree_buffer)
+    {
+        TreeKLMinhash *S = new TreeKLMinhash(k, l, UINT32_MAX, false);
+        t = timeSingleSetImplicit(S, sample, N, n_fault);
+        delete S;
+    }
+    else
+    {
+        ArrayKLMinhash *S = new ArrayKLMinhash(k, l, UINT32_MAX, false);
+        t = timeSingleSetImplicit(S, sample, N, n_fault);
+        delete S;
+    }
+    long long misses = counter.stop();
+
+    double missesPerOp = misses < 0 ? -1 : (double)misses / (2.0 * N);
+    printf("%s-DMH-misses, %d, %d, %u, %d, %f, %lld, %f\n", tree_buffer ? "tree" : "array", k, l, 2 * N, n_fault, t, misses, missesPerOp);
+
+    delete[] sample;
+}
+
+/**
+ * This experiment compares the virtual and the devirtualized hashing paths of the BufferKLMinhash sketch, on the workload of singleSetImplicit.
+ * The same k hash functions of the family H are used both by TreeKLMinhash (type-erased, one virtual call per hash evaluation)
+ * and by BasicTreeKLMinhash<H> (the hash functions are called directly).
+ * Note that for TabulationHash both sketches copy the hash functions into a HashBank and evaluate them all at once.
+ * @param k number of hash functions
+ * @param l size of the buffers
+ * @param N 2*N is the number of operations
+ * @param family the name of the hash family, printed in the results
+ */
+template <class H>
+void singleSetImplicitDispatch(int k, int l, int N, const char *family)
+{
+    H **hashes = (H **)malloc(k * sizeof(H *));
+    for (int i = 0; i < k; i++)
+        hashes[i] = new H();
+
+    // generate a random sample
+    uint32_t *sample = generate_random_sample(N);
+
+    // virtual path
+    TreeKLMinhash *S1 = new TreeKLMinhash(k, l, UINT32_MAX, (Hash<uint32_t> **)hashes, false);
+    int n_fault_virtual = 0;
+    float t_virtual = timeSingleSetImplicit(S1, sample, N, n_fault_virtual);
+
+    // devirtualized path
+    BasicTreeKLMinhash<H> *S2 = new BasicTreeKLMinhash<H>(k, l, UINT32_MAX, hashes, false);
+    int n_fault_static = 0;
+    float t_static = timeSingleSetImplicit(S2, sample, N, n_fault_static);
+
+    // print the results
+    printf("tree-DMH-virtual, %s, %d, %d, %u, %d, %f\n", family, k, l, 2 * N, n_fault_virtual, t_virtual);
+    printf("tree-DMH-static, %s, %d, %d, %u, %d, %f\n", family, k, l, 2 * N, n_fault_static, t_static);
+
+    delete S1;
+    delete S2;
+    for (int i = 0; i < k; i++)
+        delete hashes[i];
+    free(hashes);
+    delete[] sample;
+}
+
+/**
+ * This experiment evaluates the construction time of the BufferKLMinhash sketch.
+ * It compares the construction of n sketches on k TabulationHash objects each, with the construction of
+ * n sketches whose k hash functions are derived from a seed, and stored in a single HashBank.
+ * @param k number of hash functions
+ * @param l size of the buffers
+ * @param n number of sketches
+ */
+void testKLMinhashConstruction(int k, int l, int n)
+{
+    // sketches on k TabulationHash objects
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < n; i++)
+    {
+        BasicTreeKLMinhash<TabulationHash<uint32_t>> *S = new BasicTreeKLMinhash<TabulationHash<uint32_t>>(k, l, UINT32_MAX, false);
+        delete S;
+    }
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+    float t_objects = (float)duration.count() / 1000000.0;
+
+    // seeded sketches
+    start = high_resolution_clock::now();
+    for (int i = 0; i < n; i++)
+    {
+        TreeKLMinhash *S = new TreeKLMinhash(k, l, UINT32_MAX, false, (uint64_t)i);
+        delete S;
+    }
+    duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+    float t_seeded = (float)duration.count() / 1000000.0;
+
+    // print the results
+    printf("tree-DMH-objects, %d, %d, %d, %f\n", k, l, n, t_objects);
+    printf("tree-DMH-seeded, %d, %d, %d, %f\n", k, l, n, t_seeded);
+}
+
 /**
  * This experiment evaluates the performance of the BufferKLMinhash sketch.
  * The sketch is created with k buffers of size l.
@@ -159,6 +986,100 @@ void slidingWindowMinHash(int k, int l, uint32_t U, int N, int max_size, bool tr
     delete S;
 }
 
+/**
+ * This experiment evaluates the performance of the OPHKLMinhash sketch on the sliding window model (see slidingWindowMinHash).
+ * @param k number of bins
+ * @param l size of the buffers
+ * @param U size of the universe
+ * @param N 2*N is the number of operations
+ * @param max_size size of the sliding window
+ */
+void slidingWindowOPH(int k, int l, uint32_t U, int N, int max_size)
+{
+    OPHKLMinhash *S = new OPHKLMinhash(k, l, U, false);
+
+    for (int j = 0; j < max_size; j++)
+        S->insert(j);
+
+    auto start = high_resolution_clock::now();
+    int n_fault = 0;
+    int first = 0;
+    for (uint32_t i = 0; i < N; i++)
+    {
+        bool doFault = S->remove(first);
+        if (doFault)
+        {
+            n_fault++;
+            for (uint32_t j = first + 1; j < first + max_size; j++)
+                S->insert(j);
+        }
+        S->insert(first + max_size + 1);
+        first++;
+    }
+
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+    float t = (float)duration.count() / 1000000.0;
+
+    printf("OPH-DMH, %d, %d, %u, %d, %d, %f\n", k, l, 2 * N, max_size, n_fault, t);
+
+    delete S;
+}
+
+/**
+ * Sliding window experiment (see slidingWindowMinHash) with an explicit set, that compares the recovery by rehashing
+ * the set with the recovery from the hash memo.
+ * The memo keeps the hash values in the lowest fraction c * l / max_size of the range: a row rebuilt from it holds about c * l values
+ * (c = 0 disables the memo). It prints the number of faults, the size of the memo (in bytes) after the last operation, and the time.
+ * @param k number of hash functions
+ * @param l size of the buffers
+ * @param N 2*N is the number of operations
+ * @param max_size size of the sliding window
+ * @param c size of the memo, in buffers
+ * @param tree_buffer if true, the sketch is created with a tree buffer, otherwise an array buffer is used
+ */
+void slidingWindowMinHashMemo(int k, int l, int N, int max_size, double c, bool tree_buffer = true)
+{
+    int n_fault = 0;
+    size_t bytes = 0;
+
+    auto run = [&](auto *S)
+    {
+        S->setHashMemo(c * l / max_size);
+        for (int j = 0; j < max_size; j++)
+            S->insert(j);
+
+        auto start = high_resolution_clock::now();
+        int first = 0;
+        for (int i = 0; i < N; i++)
+        {
+            n_fault += S->remove(first);
+            S->insert(first + max_size + 1);
+            first++;
+        }
+
+        auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+        if (S->getHashMemo() != nullptr)
+            bytes = S->getHashMemo()->bytes();
+        return (float)duration.count() / 1000000.0;
+    };
+
+    float t;
+    if (tree_buffer)
+    {
+        TreeKLMinhash *S = new TreeKLMinhash(k, l, UINT32_MAX, true);
+        t = run(S);
+        delete S;
+    }
+    else
+    {
+        ArrayKLMinhash *S = new ArrayKLMinhash(k, l, UINT32_MAX, true);
+        t = run(S);
+        delete S;
+    }
+
+    printf("%s-DMH-memo, %d, %d, %u, %d, %.1f, %d, %zu, %f\n", tree_buffer ? "tree" : "array", k, l, 2 * N, max_size, c, n_fault, bytes, t);
+}
+
 /**
  * This experiment evaluates the performance of the DSS sketch.
  * The sketch first inserts N elements and then removes them, measuring the time.
@@ -272,88 +1193,461 @@ void testDSSQuery(int c, int size, int n_query, int n_hashes)
 }
 
 /**
- * This experiment evaluates the performance of the DSSProactive sketch, after a sequence of queries.
- * The sketch is initialized with `size` elements.
- * Then the time needed to execute `n_query` queries is measured.
+ * This experiment evaluates the performance of the DSSProactive sketch, after a sequence of queries.
+ * The sketch is initialized with `size` elements.
+ * Then the time needed to execute `n_query` queries is measured.
+ */
+void testDSSProactiveQuery(int c, int size, int n_query, int n_hashes)
+{
+    // create a new DSSProactive sketch
+    DSSProactive *S = new DSSProactive(c, n_hashes);
+
+    // generate a random sample
+    uint32_t *sample = generate_random_sample(size);
+
+    // insert all elements in the sketch
+    for (int i = 0; i < size; i++)
+        S->insert(sample[i]);
+
+    // start the timer
+    auto start = high_resolution_clock::now();
+
+    // execute n_query queries
+    for (int i = 0; i < n_query; i++)
+        S->getSignature();
+
+    // stop the timer
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+    float t = (float)duration.count() / 1000000.0;
+
+    // print the results
+    printf("DSSp, %d, %d, %u, %u, %d, %f\n", c, S->k, size, n_query, n_hashes, t);
+
+    delete S;
+    delete[] sample;
+}
+
+/**
+ * This experiment evaluates the performance of the BufferKLMinhash sketch, after a sequence of queries.
+ * The sketch is initialized with `size` elements.
+ * Then the time needed to execute `n_query` queries is measured.
+ * @param l size of the buffers
+ * @param size the size of the initial sample
+ * @param n_query the number of queries
+ * @param n_hashes number of hash functions
+ * @param tree_buffer if true, the sketch is created with a tree buffer, otherwise an array buffer is used
+ */
+void testKLMinhashQuery(int l, int size, int n_query, int n_hashes, bool tree_buffer = true)
+{
+    Sketch *S;
+    if (tree_buffer)
+    {
+        // create a new TreeKLMinhash sketch
+        S = new TreeKLMinhash(n_hashes, l, UINT32_MAX, false);
+    }
+    else
+    {
+        // create a new ArrayKLMinhash sketch
+        S = new ArrayKLMinhash(n_hashes, l, UINT32_MAX, false);
+    }
+
+    // generate a random sample
+    uint32_t *sample = generate_random_sample(size);
+
+    // insert all elements in the sketch
+    for (int i = 0; i < size; i++)
+        S->insert(sample[i]);
+
+    // start the timer
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < n_query; i++)
+        S->getSignature();
+
+    // stop the timer
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+    float t = (float)duration.count() / 1000000.0;
+
+    // print the results
+    if (tree_buffer)
+        printf("tree-DMH, %d, %d, %u, %u, %f\n", n_hashes, l, size, n_query, t);
+    else
+        printf("array-DMH, %d, %d, %u, %u, %f\n", n_hashes, l, size, n_query, t);
+
+    delete S;
+    delete[] sample;
+}
+
+/**
+ * This experiment evaluates the performance of the OPHKLMinhash sketch, after a sequence of queries (see testKLMinhashQuery).
+ * The queries include the densification of the empty bins.
+ * @param l size of the buffers
+ * @param size the size of the initial sample
+ * @param n_query the number of queries
+ * @param k number of bins
+ */
+void testOPHQuery(int l, int size, int n_query, int k)
+{
+    // create a new OPHKLMinhash sketch
+    OPHKLMinhash *S = new OPHKLMinhash(k, l, UINT32_MAX, false);
+
+    // generate a random sample
+    uint32_t *sample = generate_random_sample(size);
+
+    // insert all elements in the sketch
+    for (int i = 0; i < size; i++)
+        S->insert(sample[i]);
+
+    // start the timer
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < n_query; i++)
+        S->getSignature();
+
+    // stop the timer
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+    float t = (float)duration.count() / 1000000.0;
+
+    // print the results
+    printf("OPH-DMH, %d, %d, %u, %u, %f\n", k, l, size, n_query, t);
+
+    delete S;
+    delete[] sample;
+}
+
+/**
+ * This experiment compares the b-bit signatures (BBitSignatures) with the full signatures of TreeKLMinhash, in memory and comparison throughput.
+ * It builds n_sketches sketches of random sets (with the same hash functions), stores their b-bit signatures,
+ * and compares every sketch with all the others (one-vs-all queries) with TreeKLMinhash::similarity and with the b-bit kernel.
+ * @param k size of the signatures
+ * @param b number of bits of the b-bit signatures
+ * @param n_sketches the number of sketches
+ * @param size the size of the sets
+ * @param n_query the number of one-vs-all queries
+ */
+void testBBitQuery(int k, int b, int n_sketches, int size, int n_query)
+{
+    HashBank *bank = new HashBank(k);
+    TreeKLMinhash **S = new TreeKLMinhash *[n_sketches];
+    BBitSignatures *M = new BBitSignatures(n_sketches, k, b);
+
+    // build the sketches and store their b-bit signatures
+    for (int s = 0; s < n_sketches; s++)
+    {
+        S[s] = new TreeKLMinhash(k, 1, UINT32_MAX, bank, false);
+        for (int i = 0; i < size; i++)
+            S[s]->insert(rand());
+        M->set(s, S[s]->getSignature());
+    }
+
+    // one-vs-all queries on the full signatures
+    double sum = 0;
+    auto start = high_resolution_clock::now();
+    for (int q = 0; q < n_query; q++)
+        for (int s = 0; s < n_sketches; s++)
+            sum += TreeKLMinhash::similarity(S[q % n_sketches], S[s]);
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+    float t_full = (float)duration.count() / 1000000.0;
+
+    // one-vs-all queries on the b-bit signatures
+    double sum_b = 0;
+    start = high_resolution_clock::now();
+    for (int q = 0; q < n_query; q++)
+        for (int s = 0; s < n_sketches; s++)
+            sum_b += M->similarity(q % n_sketches, s);
+    duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+    float t_bbit = (float)duration.count() / 1000000.0;
+
+    // print the results: memory (bytes of the signatures), time and average estimation
+    size_t full_bytes = (size_t)n_sketches * k * sizeof(num);
+    double n_pairs = (double)n_query * n_sketches;
+    printf("full, %d, 32, %d, %d, %zu, %f, %f\n", k, n_sketches, n_query, full_bytes, t_full, sum / n_pairs);
+    printf("b-bit, %d, %d, %d, %d, %zu, %f, %f\n", k, b, n_sketches, n_query, M->bytes(), t_bbit, sum_b / n_pairs);
+
+    for (int s = 0; s < n_sketches; s++)
+        delete S[s];
+    delete[] S;
+    delete M;
+    delete bank;
+}
+
+/**
+ * This experiment evaluates the one-vs-many similarity queries (see compare::oneVsMany) on a block of n_signatures signatures.
+ * Every query compares a signature with all the signatures of the block, first with the scalar loop of TreeKLMinhash::similarity
+ * (one pair at a time, with a double accumulator) and then with the SIMD kernel, and prints the time and the throughput (GB/s) of the block.
+ * The signatures are random, the i-th one sharing about half of its values with the signature 0.
+ * @param k size of the signatures
+ * @param n_signatures the number of signatures of the block
+ * @param n_query the number of queries
+ */
+void testSimilarityQuery(int k, int n_signatures, int n_query)
+{
+    SignatureBlock *block = new SignatureBlock(n_signatures, k);
+    num *query = new num[k];
+    num *signature = new num[k];
+    double *out = new double[n_signatures];
+
+    // the query is the signature 0
+    for (int j = 0; j < k; j++)
+        query[j] = rand();
+    for (int i = 0; i < n_signatures; i++)
+    {
+        for (int j = 0; j < k; j++)
+            signature[j] = rand() % 2 == 0 ? query[j] : rand();
+        block->set(i, signature);
+    }
+
+    // scalar loop, one pair at a time
+    double sum = 0;
+    auto start = high_resolution_clock::now();
+    for (int q = 0; q < n_query; q++)
+    {
+        for (int i = 0; i < n_signatures; i++)
+        {
+            const num *b = block->get(i);
+            double c = .0;
+            for (int j = 0; j < k; j++)
+                c += query[j] == b[j];
+            out[i] = c / static_cast<double>(k);
+        }
+        sum += out[q % n_signatures];
+    }
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+    float t_scalar = (float)duration.count() / 1000000.0;
+
+    // one-vs-many kernel
+    double sum_simd = 0;
+    start = high_resolution_clock::now();
+    for (int q = 0; q < n_query; q++)
+    {
+        block->query(query, out);
+        sum_simd += out[q % n_signatures];
+    }
+    duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+    float t_simd = (float)duration.count() / 1000000.0;
+
+    // print the results: the throughput is the number of bytes of the block read per second
+    double gb = (double)block->bytes() * n_query / 1e9;
+    printf("scalar, %d, %d, %d, %f, %f, %f\n", k, n_signatures, n_query, t_scalar, gb / t_scalar, sum / n_query);
+    printf("one-vs-many, %d, %d, %d, %f, %f, %f\n", k, n_signatures, n_query, t_simd, gb / t_simd, sum_simd / n_query);
+
+    delete block;
+    delete[] query;
+    delete[] signature;
+    delete[] out;
+}
+
+/**
+ * This experiment evaluates the all-pairs similarity engine (AllPairs) on n_signatures random signatures.
+ * Every odd signature shares about a fraction J2 of its values with the previous one, so that there are about n_signatures / 2 similar pairs.
+ * The engine keeps the pairs with similarity at least J; if naive is true, the result is compared with the loop over all the pairs.
+ * @param k size of the signatures
+ * @param n_signatures the number of signatures
+ * @param J the similarity threshold
+ * @param J2 the similarity of the planted pairs
+ * @param naive if true, the pairs are also counted by the loop over all the pairs
+ */
+void testAllPairs(int k, int n_signatures, double J, double J2, bool naive)
+{
+    SignatureBlock *block = new SignatureBlock(n_signatures, k);
+    num *signature = new num[k];
+
+    for (int i = 0; i < n_signatures; i++)
+    {
+        for (int j = 0; j < k; j++)
+            if (i % 2 == 0 || rand() / (double)RAND_MAX >= J2)
+                signature[j] = rand();
+        block->set(i, signature);
+    }
+
+    AllPairs *engine = new AllPairs(block);
+
+    // start the timer
+    auto start = high_resolution_clock::now();
+    size_t n_pairs = engine->run(J);
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+    float t = (float)duration.count() / 1000000.0;
+
+    // the throughput is the number of signature bytes compared per second
+    double gb = (double)n_signatures * (n_signatures - 1) / 2 * k * sizeof(num) / 1e9;
+    printf("all-pairs, %d, %d, %zu, %f, %zu, %f, %f\n", k, n_signatures, engine->getTile(), J, n_pairs, t, gb / t);
+
+    if (naive)
+    {
+        size_t n_naive = 0;
+        start = high_resolution_clock::now();
+        for (int a = 0; a < n_signatures; a++)
+            for (int b = a + 1; b < n_signatures; b++)
+                n_naive += compare::jaccard(block->get(a), block->get(b), k) >= J;
+        duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+        t = (float)duration.count() / 1000000.0;
+
+        printf("naive, %d, %d, %d, %f, %zu, %f, %f\n", k, n_signatures, 1, J, n_naive, t, gb / t);
+    }
+
+    delete engine;
+    delete block;
+    delete[] signature;
+}
+
+/**
+ * This experiment evaluates the dynamic LSH index (DynamicLSH) of n_sets TreeKLMinhash sketches under a sequence of updates.
+ * The sets are random subsets of size size of a universe of U elements, and every update inserts a new element in a random set
+ * or removes one of its elements (with probability 1/2). After every update the index is updated from the dirty rows of the sketch,
+ * and the candidates of the set are queried. At the end, the candidates of every set are compared with the ones of an index built from scratch.
+ * @param n_sets the number of sets
+ * @param b number of bands
+ * @param r number of values of each band
+ * @param l size of the buffers
+ * @param U size of the universe
+ * @param size the initial size of the sets
+ * @param n_updates the number of updates
  */
-void testDSSProactiveQuery(int c, int size, int n_query, int n_hashes)
+void testDynamicLSH(int n_sets, int b, int r, int l, uint32_t U, int size, int n_updates)
 {
-    // create a new DSSProactive sketch
-    DSSProactive *S = new DSSProactive(c, n_hashes);
-
-    // generate a random sample
-    uint32_t *sample = generate_random_sample(size);
-
-    // insert all elements in the sketch
-    for (int i = 0; i < size; i++)
-        S->insert(sample[i]);
+    int k = b * r;
+    HashBank *bank = new HashBank(k);
+    TreeKLMinhash **S = new TreeKLMinhash *[n_sets];
+    vector<vector<num>> sets(n_sets);
+    DynamicLSH *index = new DynamicLSH(b, r);
+
+    // build the sketches and the index
+    for (int s = 0; s < n_sets; s++)
+    {
+        S[s] = new TreeKLMinhash(k, l, UINT32_MAX, bank, true);
+        unordered_set<num> elements;
+        while (elements.size() < (size_t)size)
+            elements.insert(rand() % U);
+        for (num x : elements)
+        {
+            S[s]->insert(x);
+            sets[s].push_back(x);
+        }
+        index->addSketch(s, S[s]);
+    }
 
     // start the timer
+    int n_fault = 0, moved = 0, n_query = 0;
+    size_t n_candidates = 0;
     auto start = high_resolution_clock::now();
 
-    // execute n_query queries
-    for (int i = 0; i < n_query; i++)
-        S->getSignature();
+    for (int u = 0; u < n_updates; u++)
+    {
+        int s = rand() % n_sets;
+        if (rand() % 2 == 0 && sets[s].size() > 1)
+        {
+            int e = rand() % sets[s].size();
+            n_fault += S[s]->remove(sets[s][e]);
+            sets[s][e] = sets[s].back();
+            sets[s].pop_back();
+        }
+        else
+        {
+            num x = rand() % U;
+            if (find(sets[s].begin(), sets[s].end(), x) != sets[s].end())
+                continue;
+            S[s]->insert(x);
+            sets[s].push_back(x);
+        }
+
+        moved += index->update(s, S[s]);
+        n_candidates += index->candidates(s).size();
+        n_query++;
+    }
 
     // stop the timer
     auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
     float t = (float)duration.count() / 1000000.0;
 
-    // print the results
-    printf("DSSp, %d, %d, %u, %u, %d, %f\n", c, S->k, size, n_query, n_hashes, t);
+    // rebuild the index from scratch, and compare the candidates of every set
+    start = high_resolution_clock::now();
+    DynamicLSH *rebuilt = new DynamicLSH(b, r);
+    for (int s = 0; s < n_sets; s++)
+        rebuilt->add(s, S[s]->getSignature());
+    duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+    float t_rebuild = (float)duration.count() / 1000000.0;
 
-    delete S;
-    delete[] sample;
+    int mismatches = 0;
+    for (int s = 0; s < n_sets; s++)
+    {
+        vector<int> A = index->candidates(s), B = rebuilt->candidates(s);
+        sort(A.begin(), A.end());
+        sort(B.begin(), B.end());
+        mismatches += A != B;
+    }
+
+    // print the results
+    printf("dynamic-LSH, %d, %d, %d, %d, %d, %d, %d, %zu, %d, %f, %f\n", n_sets, b, r, n_updates, n_fault, moved, mismatches, n_candidates, n_query, t, t_rebuild);
+
+    for (int s = 0; s < n_sets; s++)
+        delete S[s];
+    delete[] S;
+    delete index;
+    delete rebuilt;
+    delete bank;
 }
 
 /**
- * This experiment evaluates the performance of the BufferKLMinhash sketch, after a sequence of queries.
- * The sketch is initialized with `size` elements.
- * Then the time needed to execute `n_query` queries is measured.
- * @param l size of the buffers
- * @param size the size of the initial sample
- * @param n_query the number of queries
- * @param n_hashes number of hash functions
- * @param tree_buffer if true, the sketch is created with a tree buffer, otherwise an array buffer is used
+ * This experiment checks the handling of the heavy LSH buckets (see HeavyBucketPolicy) on n_heavy signatures that are equal on the band 0
+ * (a single heavy bucket) and random on the other bands, grouped in clusters of size cluster that also share the extra values of the signature
+ * (the extra values after the b * r indexed ones). The pairs of a cluster agree only on the band 0, so only the heavy bucket can find them.
+ * For the sampling and the split (on the extra values, and at random if the signatures have no extra values) it prints the number of candidates,
+ * the number of pairs of the clusters that are found, and the number of candidates that no other band finds (0 if the split only repeats the other bands).
+ * @param n_heavy the number of signatures
+ * @param b number of bands
+ * @param r number of values of each band
+ * @param extra number of values of the signatures after the b * r indexed ones
+ * @param cluster size of the clusters
+ * @param maxBucket the size above which a bucket is heavy
  */
-void testKLMinhashQuery(int l, int size, int n_query, int n_hashes, bool tree_buffer = true)
+void testHeavyBuckets(int n_heavy, int b, int r, int extra, int cluster, int maxBucket)
 {
-    Sketch *S;
-    if (tree_buffer)
+    int k = b * r + extra;
+    uint32_t **signatures = (uint32_t **)malloc(sizeof(uint32_t *) * n_heavy);
+    for (int i = 0; i < n_heavy; i++)
     {
-        // create a new TreeKLMinhash sketch
-        S = new TreeKLMinhash(n_hashes, l, UINT32_MAX, false);
+        signatures[i] = new uint32_t[k];
+        for (int j = 0; j < b * r; j++)
+            signatures[i][j] = j < r ? 0 : rand();
+        for (int j = b * r; j < k; j++)
+            signatures[i][j] = i % cluster == 0 ? rand() : signatures[i - 1][j];
     }
-    else
+
+    const char *names[3] = {"none", "sample", "split"};
+    for (int policy = 0; policy < 3; policy++)
     {
-        // create a new ArrayKLMinhash sketch
-        S = new ArrayKLMinhash(n_hashes, l, UINT32_MAX, false);
-    }
+        LSHOptions options;
+        options.k = k;
+        if (policy > 0)
+        {
+            options.maxBucket = maxBucket;
+            options.policy = policy == 1 ? HEAVY_SAMPLE : HEAVY_SPLIT;
+        }
 
-    // generate a random sample
-    uint32_t *sample = generate_random_sample(size);
+        CandidatePairs *candidatePairs = computeLSH(signatures, n_heavy, r, b, options);
+        CandidatePairs *sorted = computeLSHSorted(signatures, n_heavy, r, b, options);
 
-    // insert all elements in the sketch
-    for (int i = 0; i < size; i++)
-        S->insert(sample[i]);
+        size_t clusterPairs = 0, onlyHeavy = 0, mismatches = candidatePairs->size() != sorted->size();
+        for (pair<int, int> p : *candidatePairs)
+        {
+            mismatches += !sorted->contains(p.first, p.second);
+            clusterPairs += p.first / cluster == p.second / cluster;
 
-    // start the timer
-    auto start = high_resolution_clock::now();
-    for (int i = 0; i < n_query; i++)
-        S->getSignature();
+            bool other = false;
+            for (int j = 1; j < b && !other; j++)
+                other = memcmp(signatures[p.first] + j * r, signatures[p.second] + j * r, r * sizeof(uint32_t)) == 0;
+            onlyHeavy += !other;
+        }
 
-    // stop the timer
-    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
-    float t = (float)duration.count() / 1000000.0;
+        size_t totalClusterPairs = (size_t)(n_heavy / cluster) * cluster * (cluster - 1) / 2;
+        printf("heavy-buckets, %s, %d, %d, %d, %d, %d, %d, %zu, %zu, %zu, %zu, %zu\n", names[policy], n_heavy, b, r, extra, cluster, options.maxBucket,
+               candidatePairs->size(), clusterPairs, totalClusterPairs, onlyHeavy, mismatches);
 
-    // print the results
-    if (tree_buffer)
-        printf("tree-DMH, %d, %d, %u, %u, %f\n", n_hashes, l, size, n_query, t);
-    else
-        printf("array-DMH, %d, %d, %u, %u, %f\n", n_hashes, l, size, n_query, t);
+        delete candidatePairs;
+        delete sorted;
+    }
 
-    delete S;
-    delete[] sample;
+    for (int i = 0; i < n_heavy; i++)
+        delete[] signatures[i];
+    free(signatures);
 }
 
 /**
@@ -484,7 +1778,7 @@ void testDSSProactiveUpdatesAndQuery(int c, int N, int n_hashes, float p, int st
  * @param start the sketch could be initialized with a sample of `start` elements
  * @param tree_buffer if true, the sketch is created with a tree buffer, otherwise an array buffer is used
  */
-void testKLMinhashUpdatesAndQuery(int n_hashes, int l, int N, float p, int start = 1, bool tree_buffer)
+void testKLMinhashUpdatesAndQuery(int n_hashes, int l, int N, float p, int start = 1, bool tree_buffer = true)
 {
     Sketch *S;
     if (tree_buffer)
@@ -557,6 +1851,76 @@ void testKLMinhashUpdatesAndQuery(int n_hashes, int l, int N, float p, int start
     delete[] sample;
 }
 
+/**
+ * This experiment evaluates the performance of the OPHKLMinhash sketch, after a sequence of updates with interleaved queries
+ * (see testKLMinhashUpdatesAndQuery).
+ * @param k number of bins
+ * @param l size of the buffers
+ * @param N 2*N is the number of operations
+ * @param p fraction of queries
+ * @param start the sketch could be initialized with a sample of `start` elements
+ */
+void testOPHUpdatesAndQuery(int k, int l, int N, float p, int start = 1)
+{
+    // create a new OPHKLMinhash sketch
+    OPHKLMinhash *S = new OPHKLMinhash(k, l, UINT32_MAX, false);
+
+    // generate a random sample
+    uint32_t *sample = generate_random_sample(N + start);
+
+    // compute the number of queries
+    int n_query = (int)(1 / p);
+
+    // remove the queries from the total number of operations
+    N = N - (int)p * N;
+
+    // insert the first `start` elements in the sketch
+    for (int i = 0; i < start; i++)
+        S->insert(sample[i]);
+
+    // initialize the counter of faults
+    int n_fault = 0;
+
+    // start the timer
+    auto start_time = high_resolution_clock::now();
+
+    // insert the elements in the sketch
+    for (int i = start; i < N + start; i++)
+    {
+        if (i % n_query == 0)
+            S->getSignature();
+
+        S->insert(sample[i]);
+    }
+
+    // remove the elements from the sketch
+    for (int i = start; i < N + start; i++)
+    {
+        if (i % n_query == 0)
+            S->getSignature();
+
+        int doFault = S->remove(sample[i]);
+        if (doFault)
+        {
+            n_fault++;
+
+            // recovery query
+            for (int j = i + 1; j < N; j++)
+                S->insert(sample[j]);
+        }
+    }
+
+    // stop the timer
+    auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start_time);
+    float t = (float)duration.count() / 1000000.0;
+
+    // print the results
+    printf("OPH-DMH, %d, %d, %u, %d, %d, %.2f, %f\n", k, l, 2 * N, 1, n_fault, p, t);
+
+    delete S;
+    delete[] sample;
+}
+
 /**
  * This experiment evaluates the quality of the Similarity Estimation (SE) of the TreeKLMinhash sketch.
  * The sketch is created with k buffers of size l.
@@ -569,16 +1933,16 @@ void testKLMinhashUpdatesAndQuery(int n_hashes, int l, int N, float p, int start
  * @param U size of the universe
  * @param p1 probability of 1 in the set A
  * @param p2 probability of 1 in the set B
- * @param hashes array of (`k`) hash functions
+ * @param bank bank of (at least `k`) hash functions, shared by the two sketches
  * @return the squared error of the jacard similarity estimation
  */
-double SE_DMH(int k, int l, uint32_t U, double p1, double p2, Hash<uint32_t> **hashes)
+double SE_DMH(int k, int l, uint32_t U, double p1, double p2, HashBank *bank)
 {
     // create a new TreeKLMinhash sketch for set A
-    TreeKLMinhash *SA = new TreeKLMinhash(k, l, UINT32_MAX, hashes, false);
+    TreeKLMinhash *SA = new TreeKLMinhash(k, l, UINT32_MAX, bank, false);
 
     // create a new TreeKLMinhash sketch for set B
-    TreeKLMinhash *SB = new TreeKLMinhash(k, l, UINT32_MAX, hashes, false);
+    TreeKLMinhash *SB = new TreeKLMinhash(k, l, UINT32_MAX, bank, false);
 
     // create the sets A and B
     __type *A = create(U, 0.05);
@@ -610,6 +1974,150 @@ double SE_DMH(int k, int l, uint32_t U, double p1, double p2, Hash<uint32_t> **h
     return err * err;
 }
 
+/**
+ * This experiment evaluates the quality of the Similarity Estimation (SE) of the OPHKLMinhash sketch (see SE_DMH).
+ * @param k number of bins
+ * @param l size of the buffers
+ * @param U size of the universe
+ * @param p1 probability of 1 in the set A
+ * @param p2 probability of 1 in the set B
+ * @param seed the seed of the two sketches
+ * @return the squared error of the jacard similarity estimation
+ */
+double SE_OPH(int k, int l, uint32_t U, double p1, double p2, uint64_t seed)
+{
+    // create two OPHKLMinhash sketches with the same hash function
+    OPHKLMinhash *SA = new OPHKLMinhash(k, l, UINT32_MAX, false, seed);
+    OPHKLMinhash *SB = new OPHKLMinhash(k, l, UINT32_MAX, false, seed);
+
+    // create the sets A and B
+    __type *A = create(U, 0.05);
+    __type *B = perturbate(A, U, p1, p2);
+
+    // insert the elements in the sketches
+    for (int i = 0; i < U; i++)
+    {
+        if (get(A, i) == 1)
+            SA->insert(i);
+        if (get(B, i) == 1)
+            SB->insert(i);
+    }
+
+    // estimate the similarity between A and B
+    double estimation = OPHKLMinhash::similarity(SA, SB);
+
+    // compute the real Jaccard similarity between A and B
+    double js = jaccard_sim(A, B, U);
+
+    // return the squared error
+    double err = estimation - js;
+
+    delete SA;
+    delete SB;
+    delete[] A;
+    delete[] B;
+
+    return err * err;
+}
+
+/**
+ * This experiment evaluates the quality of the Similarity Estimation (SE) of the BottomKMinhash sketch (see SE_DMH).
+ * @param k size of the signature
+ * @param l number of extra values of the buffer
+ * @param U size of the universe
+ * @param p1 probability of 1 in the set A
+ * @param p2 probability of 1 in the set B
+ * @param seed the seed of the two sketches
+ * @return the squared error of the jacard similarity estimation
+ */
+double SE_BottomK(int k, int l, uint32_t U, double p1, double p2, uint64_t seed)
+{
+    // create two BottomKMinhash sketches with the same hash function
+    BottomKMinhash *SA = new BottomKMinhash(k, l, UINT32_MAX, false, seed);
+    BottomKMinhash *SB = new BottomKMinhash(k, l, UINT32_MAX, false, seed);
+
+    // create the sets A and B
+    __type *A = create(U, 0.05);
+    __type *B = perturbate(A, U, p1, p2);
+
+    // insert the elements in the sketches
+    for (int i = 0; i < U; i++)
+    {
+        if (get(A, i) == 1)
+            SA->insert(i);
+        if (get(B, i) == 1)
+            SB->insert(i);
+    }
+
+    // estimate the similarity between A and B
+    double estimation = BottomKMinhash::similarity(SA, SB);
+
+    // compute the real Jaccard similarity between A and B
+    double js = jaccard_sim(A, B, U);
+
+    // return the squared error
+    double err = estimation - js;
+
+    delete SA;
+    delete SB;
+    delete[] A;
+    delete[] B;
+
+    return err * err;
+}
+
+/**
+ * This experiment evaluates the quality of the Similarity Estimation (SE) of the b-bit signatures (see SE_DMH):
+ * the lowest b bits of the signatures of two TreeKLMinhash sketches are compared, and the bias is corrected (see BBitSignatures::estimate).
+ * @param k size of the signature
+ * @param l size of the buffers
+ * @param U size of the universe
+ * @param p1 probability of 1 in the set A
+ * @param p2 probability of 1 in the set B
+ * @param bank bank of (at least `k`) hash functions, shared by the two sketches
+ * @param b number of bits of the b-bit signatures
+ * @return the squared error of the jacard similarity estimation
+ */
+double SE_BBit(int k, int l, uint32_t U, double p1, double p2, HashBank *bank, int b)
+{
+    // create two TreeKLMinhash sketches with the same hash functions
+    TreeKLMinhash *SA = new TreeKLMinhash(k, l, UINT32_MAX, bank, false);
+    TreeKLMinhash *SB = new TreeKLMinhash(k, l, UINT32_MAX, bank, false);
+
+    // create the sets A and B
+    __type *A = create(U, 0.05);
+    __type *B = perturbate(A, U, p1, p2);
+
+    // insert the elements in the sketches
+    for (int i = 0; i < U; i++)
+    {
+        if (get(A, i) == 1)
+            SA->insert(i);
+        if (get(B, i) == 1)
+            SB->insert(i);
+    }
+
+    // estimate the similarity between A and B from the b-bit signatures
+    BBitSignatures *M = new BBitSignatures(2, k, b);
+    M->set(0, SA->getSignature());
+    M->set(1, SB->getSignature());
+    double estimation = M->similarity(0, 1);
+
+    // compute the real Jaccard similarity between A and B
+    double js = jaccard_sim(A, B, U);
+
+    // return the squared error
+    double err = estimation - js;
+
+    delete M;
+    delete SA;
+    delete SB;
+    delete[] A;
+    delete[] B;
+
+    return err * err;
+}
+
 /**
  * This experiment evaluates the quality of the Similarity Estimation (SE) of the DSS sketch.
  * The sketch is created with k buffers of size l.